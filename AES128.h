@@ -0,0 +1,29 @@
+/**************************************************************************
+
+    @author   Elmü
+    class AES: AES-128 block cipher (FIPS 197) for Desfire EV1 AES keys.
+    The S-Boxes are stored in flash memory (PROGMEM), only the expanded key is in RAM.
+
+**************************************************************************/
+
+#ifndef AES128_H
+#define AES128_H
+
+#include "DesFireKey.h"
+
+class AES : public DESFireKey
+{
+public:
+    AES();
+    bool SetKeyData(const byte* u8_Key, int s32_KeySize, byte u8_Version);
+    void CryptDataBlock(byte* u8_Out, const byte* u8_In, DESFireCipher e_Cipher);
+
+private:
+    void EncryptBlock(byte u8_State[16]);
+    void DecryptBlock(byte u8_State[16]);
+    void AddRoundKey(byte u8_State[16], byte u8_Round);
+
+    byte mu8_RoundKeys[176]; // 11 round keys of 16 byte
+};
+
+#endif // AES128_H
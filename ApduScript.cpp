@@ -0,0 +1,196 @@
+/**************************************************************************
+
+    class ApduScript: Executes a list of Desfire commands (see ApduScript.h)
+
+**************************************************************************/
+
+#include "ApduScript.h"
+
+// Each step starts with Flags, Expected status, Receive size, Length
+#define SCRIPT_STEP_HEADER   4
+// The longest possible parameters of a step (the script contains only this step)
+#define SCRIPT_MAX_PARAMS    (SCRIPT_MAX_SIZE - SCRIPT_STEP_HEADER - 1)
+
+ApduScript::ApduScript()
+{
+    Clear();
+}
+
+void ApduScript::Clear()
+{
+    ms32_ScriptLength = 0;
+    mu8_StepCount     = 0;
+    ms32_ResultLength = 0;
+    mu8_Executed      = 0;
+    mb_Aborted        = false;
+}
+
+/**************************************************************************
+    Loads a binary script.
+    returns false if the script is too large or not well formed
+**************************************************************************/
+bool ApduScript::Load(const byte* u8_Script, int s32_Length)
+{
+    Clear();
+    if (s32_Length > SCRIPT_MAX_SIZE)
+    {
+        //Utils::Print("Script too large\r\n");
+        return false;
+    }
+
+    memcpy(mu8_Script, u8_Script, s32_Length);
+    ms32_ScriptLength = s32_Length;
+    return CheckScript();
+}
+
+/**************************************************************************
+    Loads a script that is transmitted as hex string (2 characters per byte)
+    returns false if the string contains invalid characters or the script is not well formed
+**************************************************************************/
+bool ApduScript::LoadHex(const char* s8_Hex, int s32_Length)
+{
+    Clear();
+    if ((s32_Length & 1) || s32_Length / 2 > SCRIPT_MAX_SIZE)
+    {
+        //Utils::Print("Invalid script length\r\n");
+        return false;
+    }
+
+    for (int i=0; i<s32_Length; i++)
+    {
+        char c = s8_Hex[i];
+        byte u8_Nibble;
+        if      (c >= '0' && c <= '9') u8_Nibble = c - '0';
+        else if (c >= 'A' && c <= 'F') u8_Nibble = c - 'A' + 10;
+        else if (c >= 'a' && c <= 'f') u8_Nibble = c - 'a' + 10;
+        else return false;
+
+        if (i & 1) mu8_Script[i / 2] |= u8_Nibble;
+        else       mu8_Script[i / 2]  = u8_Nibble << 4;
+    }
+
+    ms32_ScriptLength = s32_Length / 2;
+    return CheckScript();
+}
+
+// Checks that all steps are complete and counts them
+bool ApduScript::CheckScript()
+{
+    int P = 0;
+    while (P < ms32_ScriptLength)
+    {
+        if (P + SCRIPT_STEP_HEADER > ms32_ScriptLength || mu8_StepCount == 0xFF)
+            break;
+
+        byte u8_Length = mu8_Script[P + 3];
+        if (u8_Length == 0) // a step without command
+            break;
+
+        P += SCRIPT_STEP_HEADER + u8_Length;
+        mu8_StepCount ++;
+    }
+
+    if (P != ms32_ScriptLength || mu8_StepCount == 0)
+    {
+        //Utils::Print("Invalid script\r\n");
+        Clear();
+        return false;
+    }
+    return true;
+}
+
+/**************************************************************************
+    Executes all steps of the loaded script with the card that is selected in pi_Desfire.
+    If pi_Cache is not NULL static responses are taken from the cache.
+    returns the count of executed steps or -1 if no script is loaded.
+    IsAborted() tells if the execution has stopped at a step that failed.
+**************************************************************************/
+int ApduScript::Execute(Desfire* pi_Desfire, CardCache* pi_Cache)
+{
+    ms32_ResultLength = 0;
+    mu8_Executed      = 0;
+    mb_Aborted        = false;
+
+    if (mu8_StepCount == 0)
+        return -1;
+
+    // The same buffers are used for all steps
+    TX_BUFFER(i_Command, 1);
+    TX_BUFFER(i_Params, SCRIPT_MAX_PARAMS);
+
+    for (int P=0; P < ms32_ScriptLength; P += SCRIPT_STEP_HEADER + mu8_Script[P + 3])
+    {
+        byte  u8_Flags    = mu8_Script[P];
+        byte  u8_Expected = mu8_Script[P + 1];
+        int  s32_RecvSize = mu8_Script[P + 2];
+        byte  u8_Length   = mu8_Script[P + 3];
+        byte* u8_Apdu     = mu8_Script + P + SCRIPT_STEP_HEADER;
+
+        // The data is received directly into the result buffer behind status and length
+        if (ms32_ResultLength + 2 + s32_RecvSize > SCRIPT_RESULT_SIZE)
+        {
+            //Utils::Print("Script result buffer too small\r\n");
+            mb_Aborted = true;
+            break;
+        }
+        byte* u8_Record = mu8_Result + ms32_ResultLength;
+
+        i_Command.Clear();
+        i_Command.AppendUint8(u8_Apdu[0]);
+
+        i_Params.Clear();
+        i_Params.AppendBuf(u8_Apdu + 1, u8_Length - 1);
+
+        DESFireStatus e_Status = ST_Success;
+        int s32_Read;
+        if (pi_Cache)
+            s32_Read = pi_Cache->Exchange(pi_Desfire, &i_Command, &i_Params, u8_Record + 2, s32_RecvSize, &e_Status, (u8_Flags & SCRIPT_CHAINED) > 0);
+        else if (u8_Flags & SCRIPT_CHAINED)
+            s32_Read = pi_Desfire->DataExchangeChained(&i_Command, &i_Params, u8_Record + 2, s32_RecvSize, &e_Status, MAC_None);
+        else
+            s32_Read = pi_Desfire->DataExchange       (&i_Command, &i_Params, u8_Record + 2, s32_RecvSize, &e_Status, MAC_None);
+
+        u8_Record[0] = e_Status;
+        u8_Record[1] = (s32_Read > 0) ? s32_Read : 0;
+        ms32_ResultLength += 2 + u8_Record[1];
+        mu8_Executed ++;
+
+        // The card did not respond or the PN532 failed -> the following steps would fail too
+        if (s32_Read < 0 && e_Status == ST_Success)
+        {
+            mb_Aborted = true;
+            break;
+        }
+
+        // Here the card has responded. DataExchange() returns -1 for an error status of the card (e.g. 0xA0 = application not found),
+        // but the script may expect exactly this status.
+        bool b_Expected = (u8_Flags & SCRIPT_ANY_STATUS) || e_Status == u8_Expected;
+        if (!b_Expected && !(u8_Flags & SCRIPT_CONTINUE))
+        {
+            mb_Aborted = true;
+            break;
+        }
+    }
+    return mu8_Executed;
+}
+
+/**************************************************************************
+    Gets the result of an executed step.
+    pu8_Data points into the internal buffer and is valid until the next Execute()
+**************************************************************************/
+bool ApduScript::GetStepResult(byte u8_Step, DESFireStatus* pe_Status, const byte** pu8_Data, int* ps32_Length)
+{
+    if (u8_Step >= mu8_Executed)
+        return false;
+
+    int P = 0;
+    for (byte S=0; S<u8_Step; S++)
+    {
+        P += 2 + mu8_Result[P + 1];
+    }
+
+    *pe_Status   = (DESFireStatus)mu8_Result[P];
+    *ps32_Length = mu8_Result[P + 1];
+    *pu8_Data    = mu8_Result + P + 2;
+    return true;
+}
@@ -0,0 +1,91 @@
+/**************************************************************************
+
+    class ApduScript: Executes a list of Desfire commands (APDUs) that the server sends in one response.
+    Without a script each command costs a HTTP round trip to the server.
+    With a script the commands are executed back to back and all results are sent with the next request.
+
+    The script is binary (transmitted as hex string). Each step is:
+    [Flags] [Expected status] [Receive size] [Length N] [Command] [Parameters (N-1 bytes)]
+
+    Flags:     see eScriptFlags
+    Expected:  the status that the card must return (normally 0x00 or 0xAF, but also an error status like 0xA0)
+    Receive:   the count of data bytes expected from the card
+
+    The execution stops at the first step that does not return the expected status (unless SCRIPT_CONTINUE)
+    and always after a communication error. The results of all executed steps are stored as:
+    [Status] [Length N] [Data (N bytes)]
+
+**************************************************************************/
+
+#ifndef APDUSCRIPT_H
+#define APDUSCRIPT_H
+
+#include "CardCache.h"
+
+// The maximum binary size of a script received from the server.
+// RAM: SCRIPT_MAX_SIZE in ApduScript, the same again for the parameters of a step on the stack in Execute()
+// and 2 * SCRIPT_MAX_SIZE for the hex string in loop() of the sketch.
+#ifndef SCRIPT_MAX_SIZE
+    #define SCRIPT_MAX_SIZE      128
+#endif
+
+// The maximum size of the results of all steps (2 bytes per step + the received data). RAM: in ApduScript.
+#ifndef SCRIPT_RESULT_SIZE
+    #define SCRIPT_RESULT_SIZE   256
+#endif
+
+enum eScriptFlags
+{
+    SCRIPT_CONTINUE   = 0x01, // execute the next step even if the status is not the expected one
+    SCRIPT_ANY_STATUS = 0x02, // any status of the card is accepted (e.g. optional commands)
+    SCRIPT_CHAINED    = 0x04, // additional frames (0xAF) are read immediately (see Desfire::DataExchangeChained())
+};
+
+class ApduScript
+{
+public:
+    ApduScript();
+    bool Load(const byte* u8_Script, int s32_Length);
+    bool LoadHex(const char* s8_Hex, int s32_Length);
+    void Clear();
+    int  Execute(Desfire* pi_Desfire, CardCache* pi_Cache = NULL);
+    bool GetStepResult(byte u8_Step, DESFireStatus* pe_Status, const byte** pu8_Data, int* ps32_Length);
+
+    // The count of steps in the loaded script
+    inline byte GetStepCount()
+    {
+        return mu8_StepCount;
+    }
+    // The count of steps that have been executed by the last Execute()
+    inline byte GetExecutedSteps()
+    {
+        return mu8_Executed;
+    }
+    // The binary script (e.g. to store it in the ProgramCache)
+    inline const byte* GetScript()
+    {
+        return mu8_Script;
+    }
+    inline int GetScriptLength()
+    {
+        return ms32_ScriptLength;
+    }
+    // true if the last Execute() has stopped at a step that failed
+    inline bool IsAborted()
+    {
+        return mb_Aborted;
+    }
+
+private:
+    bool CheckScript();
+
+    byte mu8_Script[SCRIPT_MAX_SIZE];
+    int  ms32_ScriptLength;
+    byte mu8_StepCount;
+    byte mu8_Result[SCRIPT_RESULT_SIZE];
+    int  ms32_ResultLength;
+    byte mu8_Executed;
+    bool mb_Aborted;
+};
+
+#endif // APDUSCRIPT_H
@@ -0,0 +1,238 @@
+/**************************************************************************
+
+    class CardCache: Keeps static responses of the cards (see CardCache.h)
+
+**************************************************************************/
+
+#include "CardCache.h"
+
+CardCache::CardCache()
+{
+    mu16_UseCounter = 0;
+    mu32_Hits       = 0;
+    mu32_Lookups    = 0;
+    Clear();
+}
+
+// Removes all cards
+void CardCache::Clear()
+{
+    for (byte C=0; C<CARD_CACHE_CARDS; C++)
+    {
+        mk_Cards[C].u8_UidLength = 0;
+    }
+    mpk_Card         = NULL;
+    mu32_Application = 0x000000;
+    mb_Authenticated = false;
+}
+
+/**************************************************************************
+    Must be called when a new card has been detected.
+    b_Authenticated = true if the card has already been authenticated (e.g. to read the real UID of a random ID card).
+    A card that is not yet in the cache replaces an empty slot or the card that has not been presented for the longest time.
+**************************************************************************/
+void CardCache::SelectCard(const byte* u8_Uid, byte u8_UidLength, bool b_Authenticated)
+{
+    mpk_Card         = NULL;
+    mu32_Application = 0x000000; // After the activation the PICC level is selected
+    mb_Authenticated = b_Authenticated;
+
+    if (u8_UidLength == 0 || u8_UidLength > CARD_CACHE_UID_SIZE)
+        return;
+
+    kCachedCard* pk_Oldest = &mk_Cards[0];
+    for (byte C=0; C<CARD_CACHE_CARDS; C++)
+    {
+        kCachedCard* pk_Card = &mk_Cards[C];
+        if (pk_Card->u8_UidLength == u8_UidLength && memcmp(pk_Card->u8_Uid, u8_Uid, u8_UidLength) == 0)
+        {
+            mpk_Card = pk_Card;
+            break;
+        }
+
+        if (pk_Oldest->u8_UidLength == 0)
+            continue;
+        if (pk_Card->u8_UidLength == 0 || (uint16_t)(mu16_UseCounter - pk_Card->u16_LastUse) > (uint16_t)(mu16_UseCounter - pk_Oldest->u16_LastUse))
+            pk_Oldest = pk_Card;
+    }
+
+    if (mpk_Card == NULL)
+    {
+        mpk_Card = pk_Oldest;
+        memcpy(mpk_Card->u8_Uid, u8_Uid, u8_UidLength);
+        mpk_Card->u8_UidLength = u8_UidLength;
+        mpk_Card->s32_Used     = 0;
+    }
+
+    // The responses have expired -> request them from the card again
+    if (mpk_Card->s32_Used > 0 && Utils::GetMillis() - mpk_Card->u32_Stored > CARD_CACHE_EXPIRY)
+        mpk_Card->s32_Used = 0;
+
+    mpk_Card->u16_LastUse = ++mu16_UseCounter;
+}
+
+// Commands that return static data of the card
+bool CardCache::IsCacheable(byte u8_Command)
+{
+    switch (u8_Command)
+    {
+        case DF_INS_GET_VERSION:
+        case DF_INS_GET_KEY_SETTINGS:
+        case DF_INS_GET_KEY_VERSION:
+        case DF_INS_GET_APPLICATION_IDS:
+        case DF_INS_GET_FILE_IDS:
+        case DF_INS_GET_FILE_SETTINGS:
+        case DFEV1_INS_GET_DF_NAMES:
+        case DFEV1_INS_GET_ISO_FILE_IDS:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Commands after which the static data of the card may have changed
+bool CardCache::IsModifying(byte u8_Command)
+{
+    switch (u8_Command)
+    {
+        case DF_INS_CHANGE_KEY_SETTINGS:
+        case DF_INS_CHANGE_KEY:
+        case DF_INS_CREATE_APPLICATION:
+        case DF_INS_DELETE_APPLICATION:
+        case DF_INS_FORMAT_PICC:
+        case DF_INS_CHANGE_FILE_SETTINGS:
+        case DF_INS_CREATE_STD_DATA_FILE:
+        case DF_INS_CREATE_BACKUP_DATA_FILE:
+        case DF_INS_CREATE_VALUE_FILE:
+        case DF_INS_CREATE_LINEAR_RECORD_FILE:
+        case DF_INS_CREATE_CYCLIC_RECORD_FILE:
+        case DF_INS_DELETE_FILE:
+        case DFEV1_INS_SET_CONFIGURATION:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// The key is the selected application, the command and the parameters.
+// The cacheable commands have at most one parameter byte, so command + parameters fit into CARD_CACHE_KEY_DATA.
+// A command with more parameters is not cached (returns false).
+bool CardCache::BuildKey(TxBuffer* pi_Command, TxBuffer* pi_Params, TxBuffer* pi_Key)
+{
+    int s32_Params = pi_Params ? pi_Params->GetCount() : 0;
+    if (pi_Command->GetCount() + s32_Params > CARD_CACHE_KEY_DATA)
+        return false;
+
+    pi_Key->AppendUint24(mu32_Application);
+    pi_Key->AppendBuf(pi_Command->GetData(), pi_Command->GetCount());
+    if (pi_Params)
+        pi_Key->AppendBuf(pi_Params->GetData(), s32_Params);
+    return true;
+}
+
+// returns the length of the response or -1 if not in the cache
+int CardCache::Find(TxBuffer* pi_Key, byte** pu8_Response)
+{
+    int P = 0;
+    while (P < mpk_Card->s32_Used)
+    {
+        byte* u8_Record   = mpk_Card->u8_Data + P;
+        byte  u8_KeyLen   = u8_Record[0];
+        byte  u8_Length   = u8_Record[1 + u8_KeyLen];
+        if (u8_KeyLen == pi_Key->GetCount() && memcmp(u8_Record + 1, pi_Key->GetData(), u8_KeyLen) == 0)
+        {
+            *pu8_Response = u8_Record + 2 + u8_KeyLen;
+            return u8_Length;
+        }
+        P += 2 + u8_KeyLen + u8_Length;
+    }
+    return -1;
+}
+
+// Appends a response to the pool of the card. If the pool is full, the response is not stored.
+void CardCache::Store(TxBuffer* pi_Key, const byte* u8_Response, int s32_Length)
+{
+    int s32_Record = 2 + pi_Key->GetCount() + s32_Length;
+    if (s32_Length > 255 || mpk_Card->s32_Used + s32_Record > CARD_CACHE_BYTES)
+        return;
+
+    if (mpk_Card->s32_Used == 0)
+        mpk_Card->u32_Stored = Utils::GetMillis();
+
+    byte* u8_Record = mpk_Card->u8_Data + mpk_Card->s32_Used;
+    u8_Record[0] = pi_Key->GetCount();
+    memcpy(u8_Record + 1, pi_Key->GetData(), pi_Key->GetCount());
+    u8_Record[1 + pi_Key->GetCount()] = s32_Length;
+    memcpy(u8_Record + 2 + pi_Key->GetCount(), u8_Response, s32_Length);
+    mpk_Card->s32_Used += s32_Record;
+}
+
+/**************************************************************************
+    Same as Desfire::DataExchange() (or DataExchangeChained() if b_Chained) with MAC_None
+    but static responses are returned from the cache if available.
+    Only complete responses with status ST_Success are stored.
+**************************************************************************/
+int CardCache::Exchange(Desfire* pi_Desfire, TxBuffer* pi_Command, TxBuffer* pi_Params, byte* u8_RecvBuf, int s32_RecvSize, DESFireStatus* pe_Status, bool b_Chained)
+{
+    byte u8_Command = pi_Command->GetData()[0];
+    bool b_Cacheable = mpk_Card != NULL && !mb_Authenticated && IsCacheable(u8_Command);
+
+    TX_BUFFER(i_Key, CARD_CACHE_KEY_SIZE);
+    if (b_Cacheable)
+        b_Cacheable = BuildKey(pi_Command, pi_Params, &i_Key);
+
+    if (b_Cacheable)
+    {
+        mu32_Lookups ++;
+
+        byte* u8_Response;
+        int s32_Length = Find(&i_Key, &u8_Response);
+        if (s32_Length >= 0 && s32_Length <= s32_RecvSize)
+        {
+            mu32_Hits ++;
+            memcpy(u8_RecvBuf, u8_Response, s32_Length);
+            if (pe_Status) *pe_Status = ST_Success;
+            return s32_Length;
+        }
+    }
+
+    DESFireStatus e_Status = ST_Success;
+    int s32_Read;
+    if (b_Chained)
+        s32_Read = pi_Desfire->DataExchangeChained(pi_Command, pi_Params, u8_RecvBuf, s32_RecvSize, &e_Status, MAC_None);
+    else
+        s32_Read = pi_Desfire->DataExchange       (pi_Command, pi_Params, u8_RecvBuf, s32_RecvSize, &e_Status, MAC_None);
+
+    if (pe_Status) *pe_Status = e_Status;
+    if (mpk_Card == NULL)
+        return s32_Read;
+
+    switch (u8_Command)
+    {
+        case DF_INS_SELECT_APPLICATION:
+            // The selection ends the authentication
+            if (s32_Read >= 0 && e_Status == ST_Success && pi_Params && pi_Params->GetCount() == 3)
+            {
+                byte* u8_App = pi_Params->GetData();
+                mu32_Application = u8_App[0] | ((uint32_t)u8_App[1] << 8) | ((uint32_t)u8_App[2] << 16);
+                mb_Authenticated = false;
+            }
+            break;
+
+        case DF_INS_AUTHENTICATE_LEGACY:
+        case DFEV1_INS_AUTHENTICATE_ISO:
+        case DFEV1_INS_AUTHENTICATE_AES:
+            mb_Authenticated = true;
+            break;
+
+        default:
+            if (IsModifying(u8_Command))
+                mpk_Card->s32_Used = 0;
+            break;
+    }
+
+    if (b_Cacheable && s32_Read >= 0 && e_Status == ST_Success)
+        Store(&i_Key, u8_RecvBuf, s32_Read);
+
+    return s32_Read;
+}
@@ -0,0 +1,89 @@
+/**************************************************************************
+
+    class CardCache: Keeps static responses of the cards that have been presented recently.
+    The same cards are presented many times a day and each time the server requests
+    the same static data (GetVersion, application IDs, file settings,...).
+    A cached response is returned without sending the command to the card.
+
+    The cards are identified by their UID (the real UID for cards in random ID mode).
+    Each card has a small pool of responses. The card that has not been presented for the longest time is replaced first.
+    All responses of a card expire CARD_CACHE_EXPIRY milliseconds after the first response has been stored.
+
+    Only commands without secure messaging are cached:
+    - After an authentication command no command is answered from the cache
+      because the CMAC of the server must stay in sync with the card. SelectApplication ends the authentication.
+    - The key includes the selected application, so GetFileSettings etc. are cached per application.
+    - Commands that change applications, files or keys clear all responses of the card.
+
+**************************************************************************/
+
+#ifndef CARDCACHE_H
+#define CARDCACHE_H
+
+#include "Desfire.h"
+
+// The count of cards in the cache
+#ifndef CARD_CACHE_CARDS
+    #define CARD_CACHE_CARDS     4
+#endif
+
+// The bytes for the responses of one card. Each response needs 2 bytes + the key (4 or 5 bytes) + the data.
+#ifndef CARD_CACHE_BYTES
+    #define CARD_CACHE_BYTES     128
+#endif
+
+// The time in milliseconds after which the responses of a card are requested from the card again (1 hour)
+#ifndef CARD_CACHE_EXPIRY
+    #define CARD_CACHE_EXPIRY    3600000
+#endif
+
+#define CARD_CACHE_UID_SIZE      8
+#define CARD_CACHE_KEY_DATA      2 // the maximum length of command + parameters of a cacheable command (see IsCacheable())
+#define CARD_CACHE_KEY_SIZE      (3 + CARD_CACHE_KEY_DATA) // the application + command + parameters
+
+struct kCachedCard
+{
+    byte     u8_Uid[CARD_CACHE_UID_SIZE];
+    byte     u8_UidLength;  // 0 = empty slot
+    uint16_t u16_LastUse;   // the card that has not been presented for the longest time is replaced first
+    uint32_t u32_Stored;    // the time when the first response has been stored (for the expiry)
+    int      s32_Used;      // bytes used in u8_Data
+    byte     u8_Data[CARD_CACHE_BYTES]; // [Key length K] [Key (K)] [Length N] [Response (N)] ...
+};
+
+class CardCache
+{
+public:
+    CardCache();
+    void SelectCard(const byte* u8_Uid, byte u8_UidLength, bool b_Authenticated = false);
+    void Clear();
+    int  Exchange(Desfire* pi_Desfire, TxBuffer* pi_Command, TxBuffer* pi_Params, byte* u8_RecvBuf, int s32_RecvSize, DESFireStatus* pe_Status, bool b_Chained);
+
+    // The count of commands that have been answered from the cache
+    inline uint32_t GetHits()
+    {
+        return mu32_Hits;
+    }
+    // The count of commands that could have been answered from the cache
+    inline uint32_t GetLookups()
+    {
+        return mu32_Lookups;
+    }
+
+private:
+    static bool IsCacheable(byte u8_Command);
+    static bool IsModifying(byte u8_Command);
+    bool BuildKey(TxBuffer* pi_Command, TxBuffer* pi_Params, TxBuffer* pi_Key);
+    int  Find(TxBuffer* pi_Key, byte** pu8_Response);
+    void Store(TxBuffer* pi_Key, const byte* u8_Response, int s32_Length);
+
+    kCachedCard  mk_Cards[CARD_CACHE_CARDS];
+    kCachedCard* mpk_Card;         // the card on the reader (NULL if none)
+    uint32_t     mu32_Application; // the selected application of the card
+    bool         mb_Authenticated; // true after an authentication command until the next SelectApplication
+    uint16_t     mu16_UseCounter;
+    uint32_t     mu32_Hits;
+    uint32_t     mu32_Lookups;
+};
+
+#endif // CARDCACHE_H
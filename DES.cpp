@@ -0,0 +1,268 @@
+/**************************************************************************
+
+    @author   Elmü
+    class DES: DES, 2K3DES and 3K3DES (FIPS 46-3)
+    The bits in the tables are numbered from 1 = MSB as in the standard.
+
+**************************************************************************/
+
+#include "DES.h"
+
+// Initial permutation
+static const byte DES_IP[64] PROGMEM =
+{
+    58, 50, 42, 34, 26, 18, 10,  2, 60, 52, 44, 36, 28, 20, 12,  4,
+    62, 54, 46, 38, 30, 22, 14,  6, 64, 56, 48, 40, 32, 24, 16,  8,
+    57, 49, 41, 33, 25, 17,  9,  1, 59, 51, 43, 35, 27, 19, 11,  3,
+    61, 53, 45, 37, 29, 21, 13,  5, 63, 55, 47, 39, 31, 23, 15,  7
+};
+
+// Final permutation (inverse of the initial permutation)
+static const byte DES_FP[64] PROGMEM =
+{
+    40,  8, 48, 16, 56, 24, 64, 32, 39,  7, 47, 15, 55, 23, 63, 31,
+    38,  6, 46, 14, 54, 22, 62, 30, 37,  5, 45, 13, 53, 21, 61, 29,
+    36,  4, 44, 12, 52, 20, 60, 28, 35,  3, 43, 11, 51, 19, 59, 27,
+    34,  2, 42, 10, 50, 18, 58, 26, 33,  1, 41,  9, 49, 17, 57, 25
+};
+
+// Expansion of the right half from 32 to 48 bit
+static const byte DES_E[48] PROGMEM =
+{
+    32,  1,  2,  3,  4,  5,  4,  5,  6,  7,  8,  9,
+     8,  9, 10, 11, 12, 13, 12, 13, 14, 15, 16, 17,
+    16, 17, 18, 19, 20, 21, 20, 21, 22, 23, 24, 25,
+    24, 25, 26, 27, 28, 29, 28, 29, 30, 31, 32,  1
+};
+
+// Permutation of the S-Box output
+static const byte DES_P[32] PROGMEM =
+{
+    16,  7, 20, 21, 29, 12, 28, 17,  1, 15, 23, 26,  5, 18, 31, 10,
+     2,  8, 24, 14, 32, 27,  3,  9, 19, 13, 30,  6, 22, 11,  4, 25
+};
+
+// Permuted choice 1: 64 bit key -> 56 bit (the parity bits are dropped)
+static const byte DES_PC1[56] PROGMEM =
+{
+    57, 49, 41, 33, 25, 17,  9,  1, 58, 50, 42, 34, 26, 18,
+    10,  2, 59, 51, 43, 35, 27, 19, 11,  3, 60, 52, 44, 36,
+    63, 55, 47, 39, 31, 23, 15,  7, 62, 54, 46, 38, 30, 22,
+    14,  6, 61, 53, 45, 37, 29, 21, 13,  5, 28, 20, 12,  4
+};
+
+// Permuted choice 2: 56 bit -> 48 bit round key
+static const byte DES_PC2[48] PROGMEM =
+{
+    14, 17, 11, 24,  1,  5,  3, 28, 15,  6, 21, 10,
+    23, 19, 12,  4, 26,  8, 16,  7, 27, 20, 13,  2,
+    41, 52, 31, 37, 47, 55, 30, 40, 51, 45, 33, 48,
+    44, 49, 39, 56, 34, 53, 46, 42, 50, 36, 29, 32
+};
+
+// Left rotations of C and D in each round
+static const byte DES_SHIFTS[16] PROGMEM = { 1, 1, 2, 2, 2, 2, 2, 2, 1, 2, 2, 2, 2, 2, 2, 1 };
+
+// S-Boxes: 8 boxes with 4 rows of 16 columns
+static const byte DES_SBOX[8][64] PROGMEM =
+{
+    { 14,  4, 13,  1,  2, 15, 11,  8,  3, 10,  6, 12,  5,  9,  0,  7,
+       0, 15,  7,  4, 14,  2, 13,  1, 10,  6, 12, 11,  9,  5,  3,  8,
+       4,  1, 14,  8, 13,  6,  2, 11, 15, 12,  9,  7,  3, 10,  5,  0,
+      15, 12,  8,  2,  4,  9,  1,  7,  5, 11,  3, 14, 10,  0,  6, 13 },
+    { 15,  1,  8, 14,  6, 11,  3,  4,  9,  7,  2, 13, 12,  0,  5, 10,
+       3, 13,  4,  7, 15,  2,  8, 14, 12,  0,  1, 10,  6,  9, 11,  5,
+       0, 14,  7, 11, 10,  4, 13,  1,  5,  8, 12,  6,  9,  3,  2, 15,
+      13,  8, 10,  1,  3, 15,  4,  2, 11,  6,  7, 12,  0,  5, 14,  9 },
+    { 10,  0,  9, 14,  6,  3, 15,  5,  1, 13, 12,  7, 11,  4,  2,  8,
+      13,  7,  0,  9,  3,  4,  6, 10,  2,  8,  5, 14, 12, 11, 15,  1,
+      13,  6,  4,  9,  8, 15,  3,  0, 11,  1,  2, 12,  5, 10, 14,  7,
+       1, 10, 13,  0,  6,  9,  8,  7,  4, 15, 14,  3, 11,  5,  2, 12 },
+    {  7, 13, 14,  3,  0,  6,  9, 10,  1,  2,  8,  5, 11, 12,  4, 15,
+      13,  8, 11,  5,  6, 15,  0,  3,  4,  7,  2, 12,  1, 10, 14,  9,
+      10,  6,  9,  0, 12, 11,  7, 13, 15,  1,  3, 14,  5,  2,  8,  4,
+       3, 15,  0,  6, 10,  1, 13,  8,  9,  4,  5, 11, 12,  7,  2, 14 },
+    {  2, 12,  4,  1,  7, 10, 11,  6,  8,  5,  3, 15, 13,  0, 14,  9,
+      14, 11,  2, 12,  4,  7, 13,  1,  5,  0, 15, 10,  3,  9,  8,  6,
+       4,  2,  1, 11, 10, 13,  7,  8, 15,  9, 12,  5,  6,  3,  0, 14,
+      11,  8, 12,  7,  1, 14,  2, 13,  6, 15,  0,  9, 10,  4,  5,  3 },
+    { 12,  1, 10, 15,  9,  2,  6,  8,  0, 13,  3,  4, 14,  7,  5, 11,
+      10, 15,  4,  2,  7, 12,  9,  5,  6,  1, 13, 14,  0, 11,  3,  8,
+       9, 14, 15,  5,  2,  8, 12,  3,  7,  0,  4, 10,  1, 13, 11,  6,
+       4,  3,  2, 12,  9,  5, 15, 10, 11, 14,  1,  7,  6,  0,  8, 13 },
+    {  4, 11,  2, 14, 15,  0,  8, 13,  3, 12,  9,  7,  5, 10,  6,  1,
+      13,  0, 11,  7,  4,  9,  1, 10, 14,  3,  5, 12,  2, 15,  8,  6,
+       1,  4, 11, 13, 12,  3,  7, 14, 10, 15,  6,  8,  0,  5,  9,  2,
+       6, 11, 13,  8,  1,  4, 10,  7,  9,  5,  0, 15, 14,  2,  3, 12 },
+    { 13,  2,  8,  4,  6, 15, 11,  1, 10,  9,  3, 14,  5,  0, 12,  7,
+       1, 15, 13,  8, 10,  3,  7,  4, 12,  5,  6, 11,  0, 14,  9,  2,
+       7, 11,  4,  1,  9, 12, 14,  2,  0,  6, 10, 13, 15,  3,  5,  8,
+       2,  1, 14,  7,  4, 10,  8, 13, 15, 12,  9,  0,  3,  5,  6, 11 }
+};
+
+// Permutes u64_In (u8_InBits wide) into a value of u8_OutBits with the table from flash
+static uint64_t Permute(uint64_t u64_In, byte u8_InBits, const byte* u8_Table, byte u8_OutBits)
+{
+    uint64_t u64_Out = 0;
+    for (byte i=0; i<u8_OutBits; i++)
+    {
+        byte u8_Pos = pgm_read_byte(u8_Table + i);
+        u64_Out = (u64_Out << 1) | ((u64_In >> (u8_InBits - u8_Pos)) & 1);
+    }
+    return u64_Out;
+}
+
+static inline uint32_t Rotate28(uint32_t u32_Data, byte u8_Count, bool b_Left)
+{
+    if (b_Left) u32_Data = (u32_Data << u8_Count) | (u32_Data >> (28 - u8_Count));
+    else        u32_Data = (u32_Data >> u8_Count) | (u32_Data << (28 - u8_Count));
+    return u32_Data & 0x0FFFFFFF;
+}
+
+// The round function f(R, K)
+static uint32_t Feistel(uint32_t u32_R, uint64_t u64_RoundKey)
+{
+    uint64_t u64_X = Permute(u32_R, 32, DES_E, 48) ^ u64_RoundKey;
+
+    uint32_t u32_Out = 0;
+    for (byte S=0; S<8; S++)
+    {
+        byte u8_Six = (byte)(u64_X >> (42 - 6 * S)) & 0x3F;
+        byte u8_Row = ((u8_Six & 0x20) >> 4) | (u8_Six & 0x01);
+        byte u8_Col =  (u8_Six >> 1) & 0x0F;
+        u32_Out = (u32_Out << 4) | pgm_read_byte(&DES_SBOX[S][u8_Row * 16 + u8_Col]);
+    }
+    return (uint32_t)Permute(u32_Out, 32, DES_P, 32);
+}
+
+static uint64_t ReadBlock(const byte* u8_Data)
+{
+    uint64_t u64_Data = 0;
+    for (byte i=0; i<8; i++)
+    {
+        u64_Data = (u64_Data << 8) | u8_Data[i];
+    }
+    return u64_Data;
+}
+
+static void WriteBlock(byte* u8_Data, uint64_t u64_Data)
+{
+    for (int i=7; i>=0; i--)
+    {
+        u8_Data[i] = (byte)u64_Data;
+        u64_Data >>= 8;
+    }
+}
+
+// ==========================================================================================
+
+DES::DES()
+{
+    mu8_BlockSize = 8;
+    mb_SimpleDes  = true;
+    memset(mu32_C, 0, sizeof(mu32_C));
+    memset(mu32_D, 0, sizeof(mu32_D));
+}
+
+/**************************************************************************
+    s32_KeySize =  8 -> DES     (stored as 2K3DES with K1 = K2)
+    s32_KeySize = 16 -> 2K3DES  (K3 = K1) or DES if both halves are equal
+    s32_KeySize = 24 -> 3K3DES
+    The parity bits (bit 0 of each byte) are ignored. Desfire stores the key version in them.
+**************************************************************************/
+bool DES::SetKeyData(const byte* u8_Key, int s32_KeySize, byte u8_Version)
+{
+    const byte* u8_Keys[3];
+    switch (s32_KeySize)
+    {
+        case 8:
+            u8_Keys[0] = u8_Key; u8_Keys[1] = u8_Key;     u8_Keys[2] = u8_Key;
+            me_KeyType = DF_KEY_2K3DES;
+            break;
+        case 16:
+            u8_Keys[0] = u8_Key; u8_Keys[1] = u8_Key + 8; u8_Keys[2] = u8_Key;
+            me_KeyType = DF_KEY_2K3DES;
+            break;
+        case 24:
+            u8_Keys[0] = u8_Key; u8_Keys[1] = u8_Key + 8; u8_Keys[2] = u8_Key + 16;
+            me_KeyType = DF_KEY_3K3DES;
+            break;
+        default:
+            me_KeyType = DF_KEY_INVALID;
+            return false;
+    }
+
+    for (byte K=0; K<3; K++)
+    {
+        uint64_t u64_CD = Permute(ReadBlock(u8_Keys[K]), 64, DES_PC1, 56);
+        mu32_C[K] = (uint32_t)(u64_CD >> 28) & 0x0FFFFFFF;
+        mu32_D[K] = (uint32_t)(u64_CD)       & 0x0FFFFFFF;
+    }
+
+    // If K1 = K2 the 3DES operation E(K1) D(K2) E(K3) is the same as a single DES operation
+    mb_SimpleDes = mu32_C[0] == mu32_C[1] && mu32_D[0] == mu32_D[1] && me_KeyType == DF_KEY_2K3DES;
+    mu8_Version  = u8_Version;
+
+    ClearIV();
+    GenerateCmacSubkeys();
+    return true;
+}
+
+// Encrypts or decrypts one block with one of the 3 keys
+uint64_t DES::CryptBlock(uint64_t u64_Data, byte u8_Key, DESFireCipher e_Cipher)
+{
+    u64_Data = Permute(u64_Data, 64, DES_IP, 64);
+    uint32_t L = (uint32_t)(u64_Data >> 32);
+    uint32_t R = (uint32_t)(u64_Data);
+
+    // After 16 rounds C and D have been rotated by 28 bits = the initial value.
+    // So decryption starts with the last round key and rotates to the right.
+    uint32_t C = mu32_C[u8_Key];
+    uint32_t D = mu32_D[u8_Key];
+    for (byte r=0; r<16; r++)
+    {
+        if (e_Cipher == KEY_ENCIPHER)
+        {
+            byte u8_Shift = pgm_read_byte(DES_SHIFTS + r);
+            C = Rotate28(C, u8_Shift, true);
+            D = Rotate28(D, u8_Shift, true);
+        }
+        else if (r > 0)
+        {
+            byte u8_Shift = pgm_read_byte(DES_SHIFTS + 16 - r);
+            C = Rotate28(C, u8_Shift, false);
+            D = Rotate28(D, u8_Shift, false);
+        }
+
+        uint64_t u64_RoundKey = Permute(((uint64_t)C << 28) | D, 56, DES_PC2, 48);
+        uint32_t u32_Temp = R;
+        R = L ^ Feistel(R, u64_RoundKey);
+        L = u32_Temp;
+    }
+
+    // The halves are swapped after the last round
+    return Permute(((uint64_t)R << 32) | L, 64, DES_FP, 64);
+}
+
+// 3DES: encrypt = E(K1) D(K2) E(K3), decrypt = D(K3) E(K2) D(K1)
+void DES::CryptDataBlock(byte* u8_Out, const byte* u8_In, DESFireCipher e_Cipher)
+{
+    uint64_t u64_Data = ReadBlock(u8_In);
+    if (mb_SimpleDes)
+    {
+        u64_Data = CryptBlock(u64_Data, 0, e_Cipher);
+    }
+    else if (e_Cipher == KEY_ENCIPHER)
+    {
+        u64_Data = CryptBlock(u64_Data, 0, KEY_ENCIPHER);
+        u64_Data = CryptBlock(u64_Data, 1, KEY_DECIPHER);
+        u64_Data = CryptBlock(u64_Data, 2, KEY_ENCIPHER);
+    }
+    else
+    {
+        u64_Data = CryptBlock(u64_Data, 2, KEY_DECIPHER);
+        u64_Data = CryptBlock(u64_Data, 1, KEY_ENCIPHER);
+        u64_Data = CryptBlock(u64_Data, 0, KEY_DECIPHER);
+    }
+    WriteBlock(u8_Out, u64_Data);
+}
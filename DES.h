@@ -0,0 +1,36 @@
+/**************************************************************************
+
+    @author   Elmü
+    class DES: DES, 2K3DES and 3K3DES (FIPS 46-3) for Desfire EV1 keys.
+    The tables are stored in flash memory (PROGMEM).
+    The round keys are calculated for each block. This is slower but saves 384 byte RAM per key.
+
+**************************************************************************/
+
+#ifndef DES_H
+#define DES_H
+
+#include "DesFireKey.h"
+
+class DES : public DESFireKey
+{
+public:
+    DES();
+    bool SetKeyData(const byte* u8_Key, int s32_KeySize, byte u8_Version);
+    void CryptDataBlock(byte* u8_Out, const byte* u8_In, DESFireCipher e_Cipher);
+
+    // true if the key is a simple DES key (2K3DES with both halves equal)
+    inline bool IsSimpleDes()
+    {
+        return mb_SimpleDes;
+    }
+
+private:
+    uint64_t CryptBlock(uint64_t u64_Data, byte u8_Key, DESFireCipher e_Cipher);
+
+    uint32_t mu32_C[3]; // the 28 bit halves of the 3 keys after permuted choice 1
+    uint32_t mu32_D[3];
+    bool     mb_SimpleDes;
+};
+
+#endif // DES_H
@@ -0,0 +1,231 @@
+/**************************************************************************
+
+    @author   Elmü
+    class DESFireKey: CBC mode and CMAC for Desfire EV1 session keys.
+
+    Desfire EV1 chains the IV through all cryptographic operations of a session:
+    The IV after encrypting the parameters or calculating a CMAC is the last cipher block
+    and is used as IV for the next operation. So each operation must be executed in the same order as in the card.
+
+**************************************************************************/
+
+#include "AES128.h"
+#include "DES.h"
+
+DESFireKey::DESFireKey()
+{
+    me_KeyType    = DF_KEY_INVALID;
+    mu8_BlockSize = 8;
+    mu8_Version   = 0;
+    memset(mu8_IV,          0, sizeof(mu8_IV));
+    memset(mu8_CmacSubKey1, 0, sizeof(mu8_CmacSubKey1));
+    memset(mu8_CmacSubKey2, 0, sizeof(mu8_CmacSubKey2));
+}
+
+// The IV must be reset after each authentication
+void DESFireKey::ClearIV()
+{
+    memset(mu8_IV, 0, sizeof(mu8_IV));
+}
+
+/**************************************************************************
+    Encrypts or decrypts data in CBC mode with the IV of the session.
+    s32_Length must be a multiple of the block size. u8_Out and u8_In may be the same buffer.
+**************************************************************************/
+bool DESFireKey::CryptDataCBC(DESFireCipher e_Cipher, byte* u8_Out, const byte* u8_In, int s32_Length)
+{
+    byte B = mu8_BlockSize;
+    if (me_KeyType == DF_KEY_INVALID || s32_Length % B)
+        return false;
+
+    byte u8_Block[16];
+    for (int P=0; P<s32_Length; P+=B)
+    {
+        if (e_Cipher == KEY_ENCIPHER)
+        {
+            // Out = E(In ^ IV), IV = Out
+            Utils::XorDataBlock(u8_Block, u8_In + P, mu8_IV, B);
+            CryptDataBlock(u8_Out + P, u8_Block, KEY_ENCIPHER);
+            memcpy(mu8_IV, u8_Out + P, B);
+        }
+        else
+        {
+            // Out = D(In) ^ IV, IV = In
+            memcpy(u8_Block, u8_In + P, B);
+            CryptDataBlock(u8_Out + P, u8_Block, KEY_DECIPHER);
+            Utils::XorDataBlock(u8_Out + P, mu8_IV, B);
+            memcpy(mu8_IV, u8_Block, B);
+        }
+    }
+    return true;
+}
+
+/**************************************************************************
+    Calculates the subkeys K1 and K2 of the CMAC (NIST SP 800-38B)
+    L = E(0), K1 = L << 1, K2 = K1 << 1 (XOR Rb if the MSB was set)
+**************************************************************************/
+void DESFireKey::GenerateCmacSubkeys()
+{
+    byte B  = mu8_BlockSize;
+    byte Rb = (B == 16) ? 0x87 : 0x1B;
+
+    byte u8_Zero[16] = {0};
+    CryptDataBlock(mu8_CmacSubKey1, u8_Zero, KEY_ENCIPHER);
+
+    bool b_Msb = (mu8_CmacSubKey1[0] & 0x80) > 0;
+    Utils::BitShiftLeft(mu8_CmacSubKey1, B);
+    if (b_Msb) mu8_CmacSubKey1[B - 1] ^= Rb;
+
+    memcpy(mu8_CmacSubKey2, mu8_CmacSubKey1, B);
+    b_Msb = (mu8_CmacSubKey2[0] & 0x80) > 0;
+    Utils::BitShiftLeft(mu8_CmacSubKey2, B);
+    if (b_Msb) mu8_CmacSubKey2[B - 1] ^= Rb;
+}
+
+/**************************************************************************
+    Calculates the CMAC over the data with the IV of the session.
+    u8_Cmac receives the block size (8 or 16 byte). Desfire transmits only the first 8 byte.
+    The data is processed block by block, so no additional buffer for the padding is required.
+    After calling ClearIV() this is the standard CMAC of NIST SP 800-38B.
+**************************************************************************/
+void DESFireKey::CalculateCmac(const byte* u8_Data, int s32_Length, byte* u8_Cmac)
+{
+    byte B = mu8_BlockSize;
+    byte u8_Block[16];
+
+    // All blocks except the last one are simply encrypted in CBC mode
+    int s32_Last = (s32_Length > 0) ? ((s32_Length - 1) / B) * B : 0;
+    for (int P=0; P<s32_Last; P+=B)
+    {
+        CryptDataCBC(KEY_ENCIPHER, u8_Block, u8_Data + P, B);
+    }
+
+    // A complete last block is XORed with K1, an incomplete one is padded with 0x80 00 00.. and XORed with K2
+    int s32_Rest = s32_Length - s32_Last;
+    memset(u8_Block, 0, B);
+    memcpy(u8_Block, u8_Data + s32_Last, s32_Rest);
+    if (s32_Rest == B)
+    {
+        Utils::XorDataBlock(u8_Block, mu8_CmacSubKey1, B);
+    }
+    else
+    {
+        u8_Block[s32_Rest] = 0x80;
+        Utils::XorDataBlock(u8_Block, mu8_CmacSubKey2, B);
+    }
+    CryptDataCBC(KEY_ENCIPHER, u8_Cmac, u8_Block, B);
+}
+
+// ==========================================================================================
+
+// Checks one result of Selftest()
+static bool CheckVector(const char* s8_Name, const byte* u8_Result, const byte* u8_Expected, int s32_Length, bool b_Print)
+{
+    bool b_OK = memcmp(u8_Result, u8_Expected, s32_Length) == 0;
+    if (!b_OK && b_Print)
+    {
+        Utils::Print(s8_Name);
+        Utils::Print(" failed: ");
+        Utils::PrintHexBuf(u8_Result, s32_Length, LF);
+    }
+    return b_OK;
+}
+
+/**************************************************************************
+    Tests DES, 3DES, AES, CBC and CMAC with the test vectors of
+    FIPS 46-3, SP 800-67, FIPS 197, SP 800-38A and SP 800-38B (RFC 4493).
+    b_Print = true -> print the failed tests and the time for 100 blocks of each cipher.
+    returns false if any result is wrong
+**************************************************************************/
+bool DESFireKey::Selftest(bool b_Print)
+{
+    static const byte KEY_AES[16]     = { 0x2B, 0x7E, 0x15, 0x16, 0x28, 0xAE, 0xD2, 0xA6, 0xAB, 0xF7, 0x15, 0x88, 0x09, 0xCF, 0x4F, 0x3C };
+    static const byte KEY_3DES[24]    = { 0x8A, 0xA8, 0x3B, 0xF8, 0xCB, 0xDA, 0x10, 0x62, 0x0B, 0xC1, 0xBF, 0x19, 0xFB, 0xB6, 0xCD, 0x58, 0xBC, 0x31, 0x3D, 0x4A, 0x37, 0x1C, 0xA8, 0xB5 };
+    static const byte KEY_2K3DES[16]  = { 0x4C, 0xF1, 0x51, 0x34, 0xA2, 0x85, 0x0D, 0xD5, 0x8A, 0x3D, 0x10, 0xBA, 0x80, 0x57, 0x0D, 0x38 };
+    static const byte MSG[20]         = { 0x6B, 0xC1, 0xBE, 0xE2, 0x2E, 0x40, 0x9F, 0x96, 0xE9, 0x3D, 0x7E, 0x11, 0x73, 0x93, 0x17, 0x2A, 0xAE, 0x2D, 0x8A, 0x57 };
+
+    // FIPS 46-3: the classic DES example
+    static const byte DES_KEY[8]      = { 0x13, 0x34, 0x57, 0x79, 0x9B, 0xBC, 0xDF, 0xF1 };
+    static const byte DES_PLAIN[8]    = { 0x01, 0x23, 0x45, 0x67, 0x89, 0xAB, 0xCD, 0xEF };
+    static const byte DES_CIPHER[8]   = { 0x85, 0xE8, 0x13, 0x54, 0x0F, 0x0A, 0xB4, 0x05 };
+    // SP 800-67: "The qufc" with K1, K2, K3 = 0123456789ABCDEF, 23456789ABCDEF01, 456789ABCDEF0123
+    static const byte TDES_KEY[24]    = { 0x01, 0x23, 0x45, 0x67, 0x89, 0xAB, 0xCD, 0xEF, 0x23, 0x45, 0x67, 0x89, 0xAB, 0xCD, 0xEF, 0x01, 0x45, 0x67, 0x89, 0xAB, 0xCD, 0xEF, 0x01, 0x23 };
+    static const byte TDES_PLAIN[8]   = { 0x54, 0x68, 0x65, 0x20, 0x71, 0x75, 0x66, 0x63 };
+    static const byte TDES_CIPHER[8]  = { 0xA8, 0x26, 0xFD, 0x8C, 0xE5, 0x3B, 0x85, 0x5F };
+    // FIPS 197 appendix C.1
+    static const byte AES_KEY[16]     = { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F };
+    static const byte AES_PLAIN[16]   = { 0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xAA, 0xBB, 0xCC, 0xDD, 0xEE, 0xFF };
+    static const byte AES_CIPHER[16]  = { 0x69, 0xC4, 0xE0, 0xD8, 0x6A, 0x7B, 0x04, 0x30, 0xD8, 0xCD, 0xB7, 0x80, 0x70, 0xB4, 0xC5, 0x5A };
+    // SP 800-38A F.2.1: CBC-AES128 with IV = 000102..0F, first block
+    static const byte CBC_CIPHER[16]  = { 0x76, 0x49, 0xAB, 0xAC, 0x81, 0x19, 0xB2, 0x46, 0xCE, 0xE9, 0x8E, 0x9B, 0x12, 0xE9, 0x19, 0x7D };
+    // RFC 4493: AES-CMAC of 0 and 16 byte
+    static const byte CMAC_AES_0[16]  = { 0xBB, 0x1D, 0x69, 0x29, 0xE9, 0x59, 0x37, 0x28, 0x7F, 0xA3, 0x7D, 0x12, 0x9B, 0x75, 0x67, 0x46 };
+    static const byte CMAC_AES_16[16] = { 0x07, 0x0A, 0x16, 0xB4, 0x6B, 0x4D, 0x41, 0x44, 0xF7, 0x9B, 0xDD, 0x9D, 0xD0, 0x4A, 0x28, 0x7C };
+    // SP 800-38B D.2 / D.3: TDEA-CMAC of 0 and 20 byte (3 keys) and of 20 byte (2 keys)
+    static const byte CMAC_3DES_0[8]  = { 0xB7, 0xA6, 0x88, 0xE1, 0x22, 0xFF, 0xAF, 0x95 };
+    static const byte CMAC_3DES_20[8] = { 0x74, 0x3D, 0xDB, 0xE0, 0xCE, 0x2D, 0xC2, 0xED };
+    static const byte CMAC_2DES_20[8] = { 0x62, 0xDD, 0x1B, 0x47, 0x19, 0x02, 0xBD, 0x4E };
+
+    AES  i_Aes;
+    DES  i_Des;
+    byte u8_Out[16];
+    bool b_OK = true;
+
+    i_Des.SetKeyData(DES_KEY, 8, 0);
+    i_Des.CryptDataBlock(u8_Out, DES_PLAIN, KEY_ENCIPHER);
+    b_OK &= CheckVector("DES encrypt", u8_Out, DES_CIPHER, 8, b_Print);
+    i_Des.CryptDataBlock(u8_Out, DES_CIPHER, KEY_DECIPHER);
+    b_OK &= CheckVector("DES decrypt", u8_Out, DES_PLAIN, 8, b_Print);
+
+    i_Des.SetKeyData(TDES_KEY, 24, 0);
+    i_Des.CryptDataBlock(u8_Out, TDES_PLAIN, KEY_ENCIPHER);
+    b_OK &= CheckVector("3DES encrypt", u8_Out, TDES_CIPHER, 8, b_Print);
+    i_Des.CryptDataBlock(u8_Out, TDES_CIPHER, KEY_DECIPHER);
+    b_OK &= CheckVector("3DES decrypt", u8_Out, TDES_PLAIN, 8, b_Print);
+
+    i_Aes.SetKeyData(AES_KEY, 16, 0);
+    i_Aes.CryptDataBlock(u8_Out, AES_PLAIN, KEY_ENCIPHER);
+    b_OK &= CheckVector("AES encrypt", u8_Out, AES_CIPHER, 16, b_Print);
+    i_Aes.CryptDataBlock(u8_Out, AES_CIPHER, KEY_DECIPHER);
+    b_OK &= CheckVector("AES decrypt", u8_Out, AES_PLAIN, 16, b_Print);
+
+    i_Aes.SetKeyData(KEY_AES, 16, 0);
+    memcpy(i_Aes.mu8_IV, AES_KEY, 16); // IV = 000102..0F
+    i_Aes.CryptDataCBC(KEY_ENCIPHER, u8_Out, MSG, 16);
+    b_OK &= CheckVector("AES CBC", u8_Out, CBC_CIPHER, 16, b_Print);
+
+    i_Aes.ClearIV();
+    i_Aes.CalculateCmac(MSG, 0, u8_Out);
+    b_OK &= CheckVector("AES CMAC 0", u8_Out, CMAC_AES_0, 16, b_Print);
+    i_Aes.ClearIV();
+    i_Aes.CalculateCmac(MSG, 16, u8_Out);
+    b_OK &= CheckVector("AES CMAC 16", u8_Out, CMAC_AES_16, 16, b_Print);
+
+    i_Des.SetKeyData(KEY_3DES, 24, 0);
+    i_Des.CalculateCmac(MSG, 0, u8_Out);
+    b_OK &= CheckVector("3DES CMAC 0", u8_Out, CMAC_3DES_0, 8, b_Print);
+    i_Des.ClearIV();
+    i_Des.CalculateCmac(MSG, 20, u8_Out);
+    b_OK &= CheckVector("3DES CMAC 20", u8_Out, CMAC_3DES_20, 8, b_Print);
+
+    i_Des.SetKeyData(KEY_2K3DES, 16, 0);
+    i_Des.CalculateCmac(MSG, 20, u8_Out);
+    b_OK &= CheckVector("2K3DES CMAC 20", u8_Out, CMAC_2DES_20, 8, b_Print);
+
+    if (b_Print)
+    {
+        DESFireKey* pi_Keys[2] = { &i_Aes, &i_Des };
+        const char* s8_Names[2] = { "AES:    ", "2K3DES: " };
+        for (byte K=0; K<2; K++)
+        {
+            uint32_t u32_Start = Utils::GetMillis();
+            for (byte i=0; i<100; i++)
+            {
+                pi_Keys[K]->CryptDataBlock(u8_Out, u8_Out, KEY_ENCIPHER);
+            }
+            Utils::Print(s8_Names[K]);
+            Utils::PrintDec(Utils::GetMillis() - u32_Start, " ms for 100 blocks" LF);
+        }
+    }
+    return b_OK;
+}
@@ -0,0 +1,71 @@
+/**************************************************************************
+
+    @author   Elmü
+    class DESFireKey: The base class of the keys (AES and DES) used for Desfire EV1 cards.
+    It implements the CBC mode and the CMAC (NIST SP 800-38B) with the session IV of the card.
+    The derived classes only encrypt / decrypt single blocks.
+
+**************************************************************************/
+
+#ifndef DESFIREKEY_H
+#define DESFIREKEY_H
+
+#include "Utils.h"
+
+// The key types as they are used in the Desfire commands (bits 6,7 of the key settings)
+enum DESFireKeyType
+{
+    DF_KEY_2K3DES  = 0x00, // for DES and 2K3DES keys
+    DF_KEY_3K3DES  = 0x40,
+    DF_KEY_AES     = 0x80,
+    DF_KEY_INVALID = 0xFF
+};
+
+enum DESFireCipher
+{
+    KEY_ENCIPHER = 0,
+    KEY_DECIPHER = 1
+};
+
+class DESFireKey
+{
+public:
+    DESFireKey();
+
+    // u8_Key = 16 byte for AES, 8 byte for DES, 16 byte for 2K3DES, 24 byte for 3K3DES
+    virtual bool SetKeyData(const byte* u8_Key, int s32_KeySize, byte u8_Version) = 0;
+    // Encrypts or decrypts one block (8 or 16 byte) without touching the IV.
+    virtual void CryptDataBlock(byte* u8_Out, const byte* u8_In, DESFireCipher e_Cipher) = 0;
+
+    bool CryptDataCBC(DESFireCipher e_Cipher, byte* u8_Out, const byte* u8_In, int s32_Length);
+    void CalculateCmac(const byte* u8_Data, int s32_Length, byte* u8_Cmac);
+    void ClearIV();
+
+    inline DESFireKeyType GetKeyType()
+    {
+        return me_KeyType;
+    }
+    // 8 byte for DES, 16 byte for AES
+    inline byte GetBlockSize()
+    {
+        return mu8_BlockSize;
+    }
+    inline byte GetKeyVersion()
+    {
+        return mu8_Version;
+    }
+
+    static bool Selftest(bool b_Print);
+
+protected:
+    void GenerateCmacSubkeys();
+
+    DESFireKeyType me_KeyType;
+    byte           mu8_BlockSize;
+    byte           mu8_Version;
+    byte           mu8_IV[16];       // the IV is chained through all operations of a session
+    byte           mu8_CmacSubKey1[16];
+    byte           mu8_CmacSubKey2[16];
+};
+
+#endif // DESFIREKEY_H
@@ -34,15 +34,16 @@
 #include "Desfire.h"
 
 Desfire::Desfire() 
+#if USE_DESFIRE
     : mi_CmacBuffer(mu8_CmacBuffer_Data, sizeof(mu8_CmacBuffer_Data))
+#endif
 {
     mu8_LastAuthKeyNo    = NOT_AUTHENTICATED;
     mu8_LastPN532Error   = 0;    
     mu32_LastApplication = 0x000000; // No application selected
-
-    // The PICC master key on an empty card is a simple DES key filled with 8 zeros
-    const byte ZERO_KEY[24] = {0};
-
+#if USE_DESFIRE
+    mpi_SessionKey       = NULL;
+#endif
 }
 
 // Whenever the RF field is switched off, these variables must be reset
@@ -54,7 +55,203 @@ bool Desfire::SwitchOffRfField()
     return PN532::SwitchOffRfField();
 }
 
+// PowerDown also switches off the RF field
+bool Desfire::PowerDown()
+{
+    mu8_LastAuthKeyNo    = NOT_AUTHENTICATED;
+    mu32_LastApplication = 0x000000; // No application selected
+
+    return PN532::PowerDown();
+}
+
+// The authentication and the selected application belong to one card
+void Desfire::SetTarget(byte u8_Tg)
+{
+    if (u8_Tg != GetTarget())
+    {
+        mu8_LastAuthKeyNo    = NOT_AUTHENTICATED;
+        mu32_LastApplication = 0x000000; // No application selected
+    }
+    PN532::SetTarget(u8_Tg);
+}
+
+#if USE_DESFIRE
+/**************************************************************************
+    Does an EV1 authentication with an AES key (0xAA) or a 2K3DES / 3K3DES key (0x1A)
+    and creates the session key that is used for all following CMAC and encryption operations.
+    The card sends an encrypted random B. The reader answers with random A + rotated random B (encrypted in CBC mode)
+    and the card proves that it knows the key by returning the rotated random A.
+    ATTENTION: The random A comes from Utils::GenerateRandom() which is not a cryptographically strong random generator.
+**************************************************************************/
+bool Desfire::Authenticate(byte u8_KeyNo, DESFireKey* pi_Key)
+{
+    if (PN532_DEBUG(1))
+    {
+        Utils::Print("\r\n*** Authenticate(KeyNo= ");
+        Utils::PrintDec(u8_KeyNo, ")\r\n");
+    }
+
+    byte u8_Command;
+    switch (pi_Key->GetKeyType())
+    { 
+        case DF_KEY_AES:    u8_Command = DFEV1_INS_AUTHENTICATE_AES; break;
+        case DF_KEY_2K3DES:
+        case DF_KEY_3K3DES: u8_Command = DFEV1_INS_AUTHENTICATE_ISO; break;
+        default:
+            //Utils::Print("Invalid key\r\n");
+            return false;
+    }
+
+    mu8_LastAuthKeyNo = NOT_AUTHENTICATED;
+
+    TX_BUFFER(i_Params, 1);
+    i_Params.AppendUint8(u8_KeyNo);
+
+    // Request a random of 16 byte, but depending of the key the card may also return an 8 byte random (2K3DES)
+    DESFireStatus e_Status;
+    byte u8_RndB_enc[16]; // encrypted random B
+    int s32_Read = DataExchange(u8_Command, &i_Params, u8_RndB_enc, 16, &e_Status, MAC_None);
+    if (e_Status != ST_MoreFrames || (s32_Read != 8 && s32_Read != 16))
+    {
+        //Utils::Print("Authentication failed (1)\r\n");
+        return false;
+    }
+
+    int s32_RandomSize = s32_Read;
+
+    byte u8_RndB[16];  // decrypted random B
+    pi_Key->ClearIV(); // Fresh start
+    pi_Key->CryptDataCBC(KEY_DECIPHER, u8_RndB, u8_RndB_enc, s32_RandomSize);
+
+    byte u8_RndB_rot[16]; // rotated random B
+    Utils::RotateBlockLeft(u8_RndB_rot, u8_RndB, s32_RandomSize);
+
+    byte u8_RndA[16];
+    Utils::GenerateRandom(u8_RndA, s32_RandomSize);
+
+    TX_BUFFER(i_RndAB, 32); // (random A + rotated random B)
+    i_RndAB.AppendBuf(u8_RndA,     s32_RandomSize);
+    i_RndAB.AppendBuf(u8_RndB_rot, s32_RandomSize);
+
+    // The IV continues from the decryption of random B
+    pi_Key->CryptDataCBC(KEY_ENCIPHER, i_RndAB, i_RndAB, 2 * s32_RandomSize);
+
+    byte u8_RndA_enc[16]; // encrypted random A
+    s32_Read = DataExchange(DF_INS_ADDITIONAL_FRAME, &i_RndAB, u8_RndA_enc, s32_RandomSize, &e_Status, MAC_None);
+    if (e_Status != ST_Success || s32_Read != s32_RandomSize)
+    {
+        //Utils::Print("Authentication failed (2)\r\n");
+        return false;
+    }
+
+    byte u8_RndA_dec[16]; // decrypted random A
+    pi_Key->CryptDataCBC(KEY_DECIPHER, u8_RndA_dec, u8_RndA_enc, s32_RandomSize);
+
+    byte u8_RndA_rot[16]; // rotated random A
+    Utils::RotateBlockLeft(u8_RndA_rot, u8_RndA, s32_RandomSize);   
+
+    if (memcmp(u8_RndA_dec, u8_RndA_rot, s32_RandomSize) != 0)
+    {
+        //Utils::Print("Authentication failed (3)\r\n");
+        return false;
+    }
+
+    // The session key is composed from random A and random B
+    TX_BUFFER(i_SessKey, 24);
+    i_SessKey.AppendBuf(u8_RndA, 4);
+    i_SessKey.AppendBuf(u8_RndB, 4);
+
+    switch (pi_Key->GetKeyType())
+    {
+        case DF_KEY_2K3DES:
+            // A simple DES key (both halves equal) results in a simple DES session key
+            if (((DES*)pi_Key)->IsSimpleDes())
+                break;
+            i_SessKey.AppendBuf(u8_RndA + 4, 4);
+            i_SessKey.AppendBuf(u8_RndB + 4, 4);
+            break;
+        case DF_KEY_3K3DES:
+            i_SessKey.AppendBuf(u8_RndA +  6, 4);
+            i_SessKey.AppendBuf(u8_RndB +  6, 4);
+            i_SessKey.AppendBuf(u8_RndA + 12, 4);
+            i_SessKey.AppendBuf(u8_RndB + 12, 4);
+            break;
+        case DF_KEY_AES:
+            i_SessKey.AppendBuf(u8_RndA + 12, 4);
+            i_SessKey.AppendBuf(u8_RndB + 12, 4);
+            break;
+        default: break;
+    }
+
+    if (pi_Key->GetKeyType() == DF_KEY_AES) mpi_SessionKey = &mi_AesSessionKey;
+    else                                    mpi_SessionKey = &mi_DesSessionKey;
+
+    // SetKeyData() also clears the IV and creates the CMAC subkeys
+    if (!mpi_SessionKey->SetKeyData(i_SessKey, i_SessKey.GetCount(), 0))
+        return false;
+
+    if (PN532_DEBUG(2))
+    {
+        Utils::Print("* SessKey:   ");
+        Utils::PrintHexBuf(i_SessKey, i_SessKey.GetCount(), LF);
+    }
+
+    mu8_LastAuthKeyNo = u8_KeyNo;   
+    return true;
+}
+#endif // USE_DESFIRE
+
+/**************************************************************************
+    Selects an application. u32_AppID = 0x000000 selects the PICC level.
+    The selection invalidates the authentication.
+**************************************************************************/
+bool Desfire::SelectApplication(uint32_t u32_AppID)
+{
+    if (PN532_DEBUG(1))
+    {
+        Utils::Print("\r\n*** SelectApplication(0x");
+        Utils::PrintHex32(u32_AppID, ")\r\n");
+    }
+
+    TX_BUFFER(i_Params, 3);
+    i_Params.AppendUint24(u32_AppID);
+
+    // This command does not return a CMAC because after selecting another application the session key is no longer valid. (Authentication required)
+    if (0 != DataExchange(DF_INS_SELECT_APPLICATION, &i_Params, NULL, 0, NULL, MAC_None))
+        return false;
+
+    mu8_LastAuthKeyNo    = NOT_AUTHENTICATED; // set to invalid value (the selected app requires authentication)
+    mu32_LastApplication = u32_AppID;
+    return true;
+}
+
+/**************************************************************************
+    Gets the version of a key in the selected application (or of the PICC master key).
+    The version allows to decide which key must be used for authentication.
+**************************************************************************/
+bool Desfire::GetKeyVersion(byte u8_KeyNo, byte* pu8_Version)
+{
+    if (PN532_DEBUG(1))
+    {
+        Utils::Print("\r\n*** GetKeyVersion(KeyNo= ");
+        Utils::PrintDec(u8_KeyNo, ")\r\n");
+    }
+
+    TX_BUFFER(i_Params, 1);
+    i_Params.AppendUint8(u8_KeyNo);
+
+    if (1 != DataExchange(DF_INS_GET_KEY_VERSION, &i_Params, pu8_Version, 1, NULL, MAC_TmacRmac))
+        return false;
+
+    if (PN532_DEBUG(1))
+    {
+        Utils::Print("Version: 0x");
+        Utils::PrintHex8(*pu8_Version, LF);
+    }
+    return true;
+}
 
+#if USE_DESFIRE
 /**************************************************************************
     Enables random ID mode in which the card sends another UID each time.
     In Random UID mode the card sends a 4 byte UID that always starts with 0x80.
@@ -70,7 +267,7 @@ bool Desfire::SwitchOffRfField()
 **************************************************************************/
 bool Desfire::EnableRandomIDForever()
 {
-    //if (mu8_DebugLevel > 0) Utils::Print("\r\n*** EnableRandomIDForever()\r\n");
+    //if (PN532_DEBUG(1)) Utils::Print("\r\n*** EnableRandomIDForever()\r\n");
 
     TX_BUFFER(i_Command, 2);
     i_Command.AppendUint8(DFEV1_INS_SET_CONFIGURATION);
@@ -92,7 +289,7 @@ bool Desfire::EnableRandomIDForever()
 **************************************************************************/
 bool Desfire::GetRealCardID(byte u8_UID[7])
 {
-    //if (mu8_DebugLevel > 0) Utils::Print("\r\n*** GetRealCardID()\r\n");
+    //if (PN532_DEBUG(1)) Utils::Print("\r\n*** GetRealCardID()\r\n");
 
     if (mu8_LastAuthKeyNo == NOT_AUTHENTICATED)
     {
@@ -115,7 +312,7 @@ bool Desfire::GetRealCardID(byte u8_UID[7])
     byte u8_Status = ST_Success;
     uint32_t u32_Crc2 = Utils::CalcCrc32(u8_UID, 7, &u8_Status, 1);
 
-    if (mu8_DebugLevel > 1)
+    if (PN532_DEBUG(2))
     {
         Utils::Print("* CRC:       0x");
         Utils::PrintHex32(u32_Crc2, LF);
@@ -127,13 +324,14 @@ bool Desfire::GetRealCardID(byte u8_UID[7])
         return false;
     }
 
-    if (mu8_DebugLevel > 0)
+    if (PN532_DEBUG(1))
     {
         //Utils::Print("Real UID: ");
         Utils::PrintHexBuf(u8_UID, 7, LF);
     }
     return true;
 }
+#endif // USE_DESFIRE
 
 
 // ########################################################################
@@ -152,6 +350,19 @@ byte Desfire::GetLastPN532Error()
     return mu8_LastPN532Error;
 }
 
+/**************************************************************************
+    returns the maximum total length of a packet that can be transfered to / from the current card.
+    This replaces the fixed MAX_FRAME_SIZE: The frame size (FSC) from the ATS of the card
+    minus 4 bytes for the ISO14443-4 frame (PCB, CRC) is also limited by the packet buffer of the PN532.
+    Larger data must be split into several Desfire frames (DF_INS_ADDITIONAL_FRAME).
+**************************************************************************/
+int Desfire::GetMaxFrameSize()
+{
+    int s32_FrameSize = GetAtsProfile()->u16_FrameSize - 4;
+    int s32_BufSize   = PN532_PACKBUFFSIZE - 19; // Overhead of DataExchange() with CMAC
+    return (s32_FrameSize < s32_BufSize) ? s32_FrameSize : s32_BufSize;
+}
+
 /**************************************************************************
     Sends data to the card and receives the response.
     u8_Command    = Desfire command without additional paramaters
@@ -191,14 +402,8 @@ int Desfire::DataExchange(TxBuffer* pi_Command,               // in (command + p
     // - data bytes ...
     int s32_Overhead = 11; // Overhead added to payload = 11 bytes = 7 bytes for PN532 frame + 3 bytes for INDATAEXCHANGE response + 1 card status byte
     if (e_Mac & MAC_Rmac) s32_Overhead += 8; // + 8 bytes for CMAC
+    if (s32_Overhead - 7 + s32_RecvSize > PN532_NORMAL_FRAME_MAX) s32_Overhead += 3; // + 3 bytes for an extended frame (LENM, LENL, LCS)
   
-    // mu8_PacketBuffer is used for input and output
-    if (2 + pi_Command->GetCount() + pi_Params->GetCount() > PN532_PACKBUFFSIZE || s32_Overhead + s32_RecvSize > PN532_PACKBUFFSIZE)    
-    {
-        //Utils::Print("DataExchange(): Invalid parameters\r\n");
-        return -1;
-    }
-
     if (e_Mac & (MAC_Tcrypt | MAC_Rcrypt))
     {
         if (mu8_LastAuthKeyNo == NOT_AUTHENTICATED)
@@ -208,11 +413,26 @@ int Desfire::DataExchange(TxBuffer* pi_Command,               // in (command + p
         }
     }
 
-    byte u8_Command = pi_Command->GetData()[0];
+    // Encrypted parameters are sent with a CRC32 appended and padded with zeroes to the block size of the session key
+    int s32_ParamCount = pi_Params->GetCount();
+#if USE_DESFIRE
+    if (e_Mac & MAC_Tcrypt)
+    {
+        int B = mpi_SessionKey->GetBlockSize();
+        s32_ParamCount = ((s32_ParamCount + 4 + B - 1) / B) * B;
+    }
+#endif
+  
+    // mu8_PacketBuffer is used for input and output
+    if (2 + pi_Command->GetCount() + s32_ParamCount > PN532_PACKBUFFSIZE || s32_Overhead + s32_RecvSize > PN532_PACKBUFFSIZE)    
+    {
+        //Utils::Print("DataExchange(): Invalid parameters\r\n");
+        return -1;
+    }
 
     int P=0;
     mu8_PacketBuffer[P++] = PN532_COMMAND_INDATAEXCHANGE;
-    mu8_PacketBuffer[P++] = 1; // Card number (Logical target number)
+    mu8_PacketBuffer[P++] = GetTarget(); // Card number (Logical target number)
 
     memcpy(mu8_PacketBuffer + P, pi_Command->GetData(), pi_Command->GetCount());
     P += pi_Command->GetCount();
@@ -220,10 +440,61 @@ int Desfire::DataExchange(TxBuffer* pi_Command,               // in (command + p
     memcpy(mu8_PacketBuffer + P, pi_Params->GetData(),  pi_Params->GetCount());
     P += pi_Params->GetCount();
 
+#if USE_DESFIRE
+    // The TX CMAC is calculated over command + parameters but it is not transmitted.
+    // It only keeps the IV of the session key in sync with the card.
+    if ((e_Mac & MAC_Tmac) && mu8_LastAuthKeyNo != NOT_AUTHENTICATED)
+    {
+        byte u8_TxMac[16];
+        mpi_SessionKey->CalculateCmac(mu8_PacketBuffer + 2, P - 2, u8_TxMac);
+    }
+
+    if (e_Mac & MAC_Tcrypt)
+    {
+        // The CRC is calculated over the command (which is not encrypted) and the parameters to be encrypted.
+        int s32_Start = 2 + pi_Command->GetCount();
+        uint32_t u32_Crc = Utils::CalcCrc32(mu8_PacketBuffer + 2, P - 2);
+        for (int i=0; i<4; i++) // the card expects the CRC in little endian on any CPU
+        {
+            mu8_PacketBuffer[P + i] = (byte)(u32_Crc >> (8 * i));
+        }
+        memset(mu8_PacketBuffer + P + 4, 0, s32_Start + s32_ParamCount - P - 4);
+        P = s32_Start + s32_ParamCount;
+
+        if (!mpi_SessionKey->CryptDataCBC(KEY_ENCIPHER, mu8_PacketBuffer + s32_Start, mu8_PacketBuffer + s32_Start, s32_ParamCount))
+            return -1;
+    }
+#endif // USE_DESFIRE
+
+    uint32_t u32_Start = Utils::GetMillis();
     if (!SendCommandCheckAck(mu8_PacketBuffer, P))
         return -1;
 
-    byte s32_Len = ReadData(mu8_PacketBuffer, s32_RecvSize + s32_Overhead);
+    // The timeout matches the frame waiting time of the card and the link quality instead of the worst case PN532_TIMEOUT
+    int s32_Len = ReadData(mu8_PacketBuffer, s32_RecvSize + s32_Overhead, GetExchangeTimeout());
+    uint16_t u16_Millis = Utils::GetMillis() - u32_Start;
+
+    // An invalid frame is an error on the bus between the CPU and the PN532, not on the RF link.
+    // It must not degrade the link quality or trigger a fallback to a lower bit rate.
+    if (s32_Len == 0 && !IsReadTimeout())
+        return -1;
+
+    if (s32_Len == 0)
+    {
+        // No response in time: The ACK aborts the command in the PN532. Then the PN532 tells why the card did not respond.
+        SendAck();
+        kGeneralStatus k_Status;
+        byte u8_Status = 0x01; // Timeout
+        if (!GetGeneralStatus(&k_Status))
+            return -1; // the PN532 does not respond either -> not an RF problem
+
+        if (k_Status.u8_Error != 0)
+            u8_Status = k_Status.u8_Error;
+
+        mu8_LastPN532Error = u8_Status;
+        UpdateLinkQuality(u16_Millis, u8_Status);
+        return -1;
+    }
 
     // ReadData() returns 3 byte if status error from the PN532
     // ReadData() returns 4 byte if status error from the Desfire card
@@ -238,6 +509,13 @@ int Desfire::DataExchange(TxBuffer* pi_Command,               // in (command + p
     byte u8_CardStatus  = mu8_PacketBuffer[3]; // contains errors from the Desfire card
 
     mu8_LastPN532Error = u8_PN532Status;
+    UpdateLinkQuality(u16_Millis, u8_PN532Status);
+
+    // Timeout, CRC, parity, framing or protocol error on the RF interface:
+    // The card may not work reliably with the higher bit rate -> go back to 106 kbps.
+    // The current command fails anyway, but the next one has a better chance.
+    if (IsRfError(u8_PN532Status))
+        FallbackBitRate();
 
     if (!CheckPN532Status(u8_PN532Status) ||s32_Len < 4)
         return -1;
@@ -249,13 +527,15 @@ int Desfire::DataExchange(TxBuffer* pi_Command,               // in (command + p
         mu8_LastAuthKeyNo = NOT_AUTHENTICATED; // A new authentication is required now
     }
 
-    if (!CheckCardStatus((DESFireStatus)u8_CardStatus))
-        return -1;
+    // The caller also gets the status if the card has returned an error
     if (pe_Status)
        *pe_Status = (DESFireStatus)u8_CardStatus;
+    if (!CheckCardStatus((DESFireStatus)u8_CardStatus))
+        return -1;
 
     s32_Len -= 4; // 3 bytes for INDATAEXCHANGE response + 1 byte card status
 
+#if USE_DESFIRE
     // A CMAC may be appended to the end of the frame.
     // The CMAC calculation is important because it maintains the IV of the session key up to date.
     // If the IV is out of sync with the IV in the card, the next encryption with the session key will result in an Integrity Error.
@@ -263,6 +543,8 @@ int Desfire::DataExchange(TxBuffer* pi_Command,               // in (command + p
         (u8_CardStatus == ST_Success || u8_CardStatus == ST_MoreFrames) && // In case of an error there is no CMAC in the response
         (mu8_LastAuthKeyNo != NOT_AUTHENTICATED))                          // No session key -> no CMAC calculation possible
     {
+        byte u8_Command = pi_Command->GetData()[0];
+
         // For example GetCardVersion() calls DataExchange() 3 times:
         // 1. u8_Command = DF_INS_GET_VERSION      -> clear CMAC buffer + append received data
         // 2. u8_Command = DF_INS_ADDITIONAL_FRAME -> append received data
@@ -286,8 +568,29 @@ int Desfire::DataExchange(TxBuffer* pi_Command,               // in (command + p
           
             byte* u8_RxMac = mu8_PacketBuffer + 4 + s32_Len;
 
+            // The CMAC is calculated over the data of all frames + the status byte
+            if (!mi_CmacBuffer.AppendBuf(mu8_PacketBuffer + 4, s32_Len) ||
+                !mi_CmacBuffer.AppendUint8(u8_CardStatus))
+                return -1;
+
+            byte u8_CalcMac[16];
+            mpi_SessionKey->CalculateCmac(mi_CmacBuffer, mi_CmacBuffer.GetCount(), u8_CalcMac);
+
+            if (PN532_DEBUG(2))
+            {
+                Utils::Print("RX CMAC:  ");
+                Utils::PrintHexBuf(u8_CalcMac, 8, LF);
+            }
+
+            // The card sends only the first 8 bytes of the CMAC
+            if (memcmp(u8_RxMac, u8_CalcMac, 8) != 0)
+            {
+                //Utils::Print("CMAC Mismatch\r\n");
+                return -1;
+            }
         }
     }
+#endif // USE_DESFIRE
 
     if (s32_Len > s32_RecvSize)
     {
@@ -299,19 +602,91 @@ int Desfire::DataExchange(TxBuffer* pi_Command,               // in (command + p
     {
         memcpy(u8_RecvBuf, mu8_PacketBuffer + 4, s32_Len);
 
+#if USE_DESFIRE
         if (e_Mac & MAC_Rcrypt) // decrypt received data with session key
         {
+            if (!mpi_SessionKey->CryptDataCBC(KEY_DECIPHER, u8_RecvBuf, u8_RecvBuf, s32_Len))
+            {
+                //Utils::Print("Invalid length of encrypted data\r\n");
+                return -1;
+            }
 
-            if (mu8_DebugLevel > 1)
+            if (PN532_DEBUG(2))
             {
                 Utils::Print("Decrypt:  ");
                 Utils::PrintHexBuf(u8_RecvBuf, s32_Len, LF);
             }        
         }    
+#endif
     }
     return s32_Len;
 }
 
+/**************************************************************************
+    Same as DataExchange() but if the card responds with ST_MoreFrames (0xAF)
+    the following frames are requested with DF_INS_ADDITIONAL_FRAME automatically.
+    All frames are collected in u8_RecvBuf and the status of the last frame is returned in pe_Status.
+    For example GetVersion (3 frames) or ReadData with a large file need only one call.
+    The RX CMAC is calculated over all frames in mi_CmacBuffer (MAC_Rmac).
+    MAC_Rcrypt is not supported because the decryption must be done over the entire data.
+    returns the byte count that has been read into u8_RecvBuf or -1 on error
+**************************************************************************/
+int Desfire::DataExchangeChained(TxBuffer* pi_Command, TxBuffer* pi_Params, byte* u8_RecvBuf, int s32_RecvSize, DESFireStatus* pe_Status, DESFireCmac e_Mac)
+{
+    if (pe_Status) *pe_Status = ST_Success;
+    if (e_Mac & MAC_Rcrypt)
+        return -1;
+
+    // Each frame must fit into the packet buffer of the PN532
+    int s32_FrameSize = GetMaxFrameSize();
+    int s32_Request   = (s32_RecvSize < s32_FrameSize) ? s32_RecvSize : s32_FrameSize;
+
+    DESFireStatus e_Status;
+    int s32_Total = DataExchange(pi_Command, pi_Params, u8_RecvBuf, s32_Request, &e_Status, e_Mac);
+
+    while (s32_Total >= 0 && e_Status == ST_MoreFrames)
+    {
+        s32_Request  = s32_RecvSize - s32_Total;
+        if (s32_Request > s32_FrameSize) s32_Request = s32_FrameSize;
+
+        int s32_Read = DataExchange(DF_INS_ADDITIONAL_FRAME, NULL, u8_RecvBuf + s32_Total, s32_Request, &e_Status, (DESFireCmac)(e_Mac & MAC_Rmac));
+        if (s32_Read < 0)
+        {
+            if (pe_Status) *pe_Status = e_Status; // ST_Success if the PN532 failed, else the error of the card
+            return -1;
+        }
+
+        // An intermediate frame without data would never end the chain.
+        // This is reported like a communication error (ST_Success) because the chain is broken.
+        if (s32_Read == 0 && e_Status == ST_MoreFrames)
+        {
+            //Utils::Print("DataExchangeChained() Empty frame\r\n");
+            return -1;
+        }
+        s32_Total += s32_Read;
+    }
+
+    if (pe_Status)
+       *pe_Status = e_Status;
+    return s32_Total;
+}
+
+#if USE_DESFIRE
+/**************************************************************************
+    Tests the local cryptography (DES, 3DES, AES, CBC, CMAC) with known test vectors.
+    No card is required. With debug level 1 the result and the speed of the ciphers are printed.
+**************************************************************************/
+bool Desfire::Selftest()
+{
+    bool b_OK = DESFireKey::Selftest(PN532_DEBUG(1));
+    if (PN532_DEBUG(1))
+    {
+        Utils::Print(b_OK ? "Crypto selftest succeeded\r\n" : "Crypto selftest failed\r\n");
+    }
+    return b_OK;
+}
+#endif
+
 // Checks the status byte that is returned from the card
 bool Desfire::CheckCardStatus(DESFireStatus e_Status)
 {
@@ -330,10 +705,12 @@ bool Desfire::CheckCardStatus(DESFireStatus e_Status)
         default: break; // This is just to avoid stupid gcc compiler warnings
     }
 
-    switch (e_Status)
+    if (PN532_DEBUG(1))
     {
-            return false;
+        Utils::Print("Desfire Error 0x");
+        Utils::PrintHex8(e_Status, LF);
     }
+    return false;
 }
 
 
@@ -4,12 +4,24 @@
 
 #include "PN532.h"
 #include "Buffer.h"
-//#include "DesFireKey.h"
+#include "AES128.h"
+#include "DES.h"
+
+// true  -> Authenticate(), GetRealCardID(), EnableRandomIDForever() and the CMAC / encryption in DataExchange() are available.
+//          The sketch authenticates Desfire cards in random ID mode with the PICC master key and reads the real UID.
+//          The CMAC and the encryption of the session are calculated on the Arduino (AES, 2K3DES, 3K3DES).
+//          ATTENTION: Set PICC_MASTER_KEY in the sketch to the key of your cards before enabling this.
+// false -> Only plain commands. Saves the session keys and the CMAC buffer (about 430 byte RAM).
+//          Cards with random ID are rejected.
+// This must be defined here because the sketch and Desfire.cpp must use the same value.
+#ifndef USE_DESFIRE
+    #define USE_DESFIRE  false
+#endif
 
 // Just an invalid key number
 #define NOT_AUTHENTICATED      255
 
-#define MAX_FRAME_SIZE         60 // The maximum total length of a packet that is transfered to / from the card
+#define MAX_FRAME_SIZE         60 // The maximum total length of a packet that is transfered to / from a card with FSC = 64 (see GetMaxFrameSize())
 
 // ------- Desfire legacy instructions --------
 
@@ -255,32 +267,46 @@ class Desfire : public PN532
 {
  public:
     Desfire();
+    bool SelectApplication(uint32_t u32_AppID);
+    bool GetKeyVersion(byte u8_KeyNo, byte* pu8_Version);
     bool GetCardVersion(DESFireCardVersion* pk_Version);
     bool FormatCard();
+    bool GetFreeMemory(uint32_t* pu32_Memory);
+#if USE_DESFIRE
+    bool Authenticate(byte u8_KeyNo, DESFireKey* pi_Key);
     bool EnableRandomIDForever();
     bool GetRealCardID(byte u8_UID[7]);
-    bool GetFreeMemory(uint32_t* pu32_Memory);
+    bool Selftest();
+#endif
     
     // ---------------------
     bool SwitchOffRfField();  // overrides PN532::SwitchOffRfField()
-    bool Selftest();
+    bool PowerDown();         // overrides PN532::PowerDown()
+    void SetTarget(byte u8_Tg); // overrides PN532::SetTarget()
     byte GetLastPN532Error(); // See comment for this function in CPP file
+    int  GetMaxFrameSize();
 
     int  DataExchange(byte      u8_Command, TxBuffer* pi_Params, byte* u8_RecvBuf, int s32_RecvSize, DESFireStatus* pe_Status, DESFireCmac e_Mac);
     int  DataExchange(TxBuffer* pi_Command, TxBuffer* pi_Params, byte* u8_RecvBuf, int s32_RecvSize, DESFireStatus* pe_Status, DESFireCmac e_Mac);  
-    
+    int  DataExchangeChained(TxBuffer* pi_Command, TxBuffer* pi_Params, byte* u8_RecvBuf, int s32_RecvSize, DESFireStatus* pe_Status, DESFireCmac e_Mac);
+
  private:
  
     bool CheckCardStatus(DESFireStatus e_Status);
 
     byte          mu8_LastAuthKeyNo; // The last key which did a successful authetication (0xFF if not yet authenticated)
     uint32_t      mu32_LastApplication;
-    //DESFireKey*   mpi_SessionKey;
     byte          mu8_LastPN532Error;
 
+#if USE_DESFIRE
+    DESFireKey*   mpi_SessionKey;    // points to mi_AesSessionKey or mi_DesSessionKey after a successful authentication
+    AES           mi_AesSessionKey;
+    DES           mi_DesSessionKey;
+
     // Must have enough space to hold the entire response from DF_INS_GET_APPLICATION_IDS (84 byte) + CMAC padding
     byte          mu8_CmacBuffer_Data[120]; 
     TxBuffer      mi_CmacBuffer;
+#endif
 };
 
 #endif
@@ -50,11 +50,22 @@
 **************************************************************************/
 PN532::PN532()
 {
-    mu8_ClkPin     = 0;
-    mu8_MisoPin    = 0;  
-    mu8_MosiPin    = 0;  
-    mu8_SselPin    = 0;  
     mu8_ResetPin   = 0;
+    mu8_IrqPin     = PN532_NO_IRQ;
+    mb_AutoPoll    = false;
+    mb_ReadTimeout = false;
+    mu8_Target     = 1;
+    mu8_ActivationRetries = 0xFF; // default of the PN532 after reset
+    mu8_AppliedRetries    = 0xFF;
+    memset(&mk_LinkQuality, 0, sizeof(mk_LinkQuality));
+    memset(mk_TargetInfo, 0, sizeof(mk_TargetInfo));
+    ParseAts(NULL, 0, &mk_TargetInfo[0].k_Ats); // ISO14443-4 defaults until a card is activated
+    ParseAts(NULL, 0, &mk_TargetInfo[1].k_Ats);
+    memset(&mk_RecoveryStats, 0, sizeof(mk_RecoveryStats));
+    mu8_RecoveryStep = REC_Resync;
+
+    // The command is written directly behind the space reserved for the frame header
+    mu8_PacketBuffer = mu8_FrameBuffer + PN532_FRAME_HEADER;
 }
 
 /**************************************************************************
@@ -80,17 +91,82 @@ PN532::PN532()
 #if USE_SOFTWARE_SPI
     void PN532::InitSoftwareSPI(byte u8_Clk, byte u8_Miso, byte u8_Mosi, byte u8_Sel, byte u8_Reset)
     {
-        mu8_ClkPin     = u8_Clk;
-        mu8_MisoPin    = u8_Miso;
-        mu8_MosiPin    = u8_Mosi;
-        mu8_SselPin    = u8_Sel;
-        mu8_ResetPin   = u8_Reset;
-    
+        mu8_ResetPin = u8_Reset;
         Utils::SetPinMode(mu8_ResetPin, OUTPUT);  
-        Utils::SetPinMode(mu8_SselPin,  OUTPUT);
-        Utils::SetPinMode(mu8_ClkPin,   OUTPUT);   
-        Utils::SetPinMode(mu8_MosiPin,  OUTPUT);
-        Utils::SetPinMode(mu8_MisoPin,  INPUT);
+
+        mi_Transport.Init(u8_Clk, u8_Miso, u8_Mosi, u8_Sel);
+    }
+#endif
+
+/**************************************************************************
+    Bus clock calibration
+    The transport starts with the configured clock (e.g. PN532_SOFT_SPI_DELAY which is made for long cables).
+    With a short cable the PN532 works reliably with a much faster clock.
+    CalibrateClock() tries the faster clock steps of the transport one after the other
+    as long as all test commands return valid frames. Then the fastest working step is kept.
+    SlowDownClock() is called by ReadData() and ReadAck() when a frame is corrupt
+    and goes back to the next slower step.
+    Call CalibrateClock() after begin() when the PN532 is known to respond.
+    Transports without clock steps (I2C, HSU, Hardware SPI) are not changed.
+**************************************************************************/
+bool PN532::CalibrateClock()
+{
+    byte u8_Good = mi_Transport.GetClockStep();
+
+    for (byte S=u8_Good+1; mi_Transport.SetClockStep(S); S++)
+    {
+        bool b_Success = true;
+        for (byte T=0; T<PN532_CALIBRATE_PROBES && b_Success; T++)
+        {
+            byte IC, VersionHi, VersionLo, Flags;
+            b_Success = GetFirmwareVersion(&IC, &VersionHi, &VersionLo, &Flags) && IC == 0x32;
+        }
+
+        if (!b_Success)
+            break;
+
+        u8_Good = S;
+    }
+
+    mi_Transport.SetClockStep(u8_Good);
+
+    // The failed test may have left a pending command in the PN532 -> abort it with an ACK
+    // and check that the PN532 works with the chosen clock.
+    SendAck();
+    byte IC, VersionHi, VersionLo, Flags;
+    bool b_Success = GetFirmwareVersion(&IC, &VersionHi, &VersionLo, &Flags);
+
+    if (PN532_DEBUG(1))
+    {
+        Utils::Print("Clock step: ");
+        Utils::PrintDec(u8_Good, LF);
+        #if USE_SOFTWARE_SPI && !defined(PN532_CUSTOM_TRANSPORT)
+            Utils::Print("Soft SPI delay: ");
+            Utils::PrintDec(mi_Transport.GetDelay(), " us" LF);
+        #endif
+    }
+    return b_Success;
+}
+
+// Goes back to the next slower clock step after a transmission error
+void PN532::SlowDownClock()
+{
+    byte u8_Step = mi_Transport.GetClockStep();
+    if (u8_Step > 0)
+        mi_Transport.SetClockStep(u8_Step - 1);
+}
+
+// returns the current clock step of the transport: 0 = configured clock, 1, 2,.. = faster
+byte PN532::GetClockStep()
+{
+    return mi_Transport.GetClockStep();
+}
+
+#if USE_SOFTWARE_SPI && !defined(PN532_CUSTOM_TRANSPORT)
+    // returns the currently used delay in microseconds between toggeling the CLK line
+    byte PN532::GetSoftSpiDelay()
+    {
+        return mi_Transport.GetDelay();
     }
 #endif
 
@@ -102,11 +178,68 @@ PN532::PN532()
 #if USE_HARDWARE_SPI
     void PN532::InitHardwareSPI(byte u8_Sel, byte u8_Reset)
     {
-        mu8_SselPin  = u8_Sel;
         mu8_ResetPin = u8_Reset;
-    
         Utils::SetPinMode(mu8_ResetPin, OUTPUT);
-        Utils::SetPinMode(mu8_SselPin,  OUTPUT);
+
+        mi_Transport.Init(u8_Sel);
+    }
+#endif
+
+/**************************************************************************
+    Initializes for HSU (High Speed UART) usage.
+    The serial port is defined in HsuClass.
+    param  reset     Location of the RSTPD_N pin
+**************************************************************************/
+#if USE_HSU
+    void PN532::InitHSU(byte u8_Reset)
+    {
+        mu8_ResetPin = u8_Reset;
+        Utils::SetPinMode(mu8_ResetPin, OUTPUT);
+    }
+
+    /**************************************************************************
+        Switches the PN532 and the serial port to another baudrate (chapter 7.2.8)
+        The PN532 answers with the old baudrate. Then the host must send an ACK
+        before both sides use the new baudrate.
+        Call this after begin() and before any other command.
+        param  baud      One of the baudrates listed for PN532_HSU_BAUD
+    **************************************************************************/
+    bool PN532::SetSerialBaudRate(uint32_t u32_Baud)
+    {
+        //if (PN532_DEBUG(1)) Utils::Print("\r\n*** SetSerialBaudRate()\r\n");
+
+        static const uint32_t u32_Rates[] = { 9600, 19200, 38400, 57600, 115200, 230400, 460800, 921600, 1288000 };
+
+        byte u8_Code = 0xFF;
+        for (byte i=0; i<sizeof(u32_Rates) / sizeof(u32_Rates[0]); i++)
+        {
+            if (u32_Rates[i] == u32_Baud)
+                u8_Code = i;
+        }
+        if (u8_Code == 0xFF)
+        {
+            //Utils::Print("SetSerialBaudRate: Invalid baudrate\r\n");
+            return false;
+        }
+
+        mu8_PacketBuffer[0] = PN532_COMMAND_SETSERIALBAUDRATE;
+        mu8_PacketBuffer[1] = u8_Code;
+
+        if (!SendCommandCheckAck(mu8_PacketBuffer, 2))
+            return false;
+
+        byte len = ReadData(mu8_PacketBuffer, 9);
+        if (len != 2 || mu8_PacketBuffer[1] != PN532_COMMAND_SETSERIALBAUDRATE + 1)
+        {
+            //Utils::Print("SetSerialBaudRate failed\r\n");
+            return false;
+        }
+
+        // The PN532 switches after receiving the ACK
+        SendAck();
+        Utils::DelayMilli(1);
+        mi_Transport.SetBaudRate(u32_Baud);
+        return true;
     }
 #endif
 
@@ -115,7 +248,9 @@ PN532::PN532()
 **************************************************************************/
 void PN532::begin() 
 {
-    //if (mu8_DebugLevel > 0) Utils::Print("\r\n*** begin()\r\n");
+    //if (PN532_DEBUG(1)) Utils::Print("\r\n*** begin()\r\n");
+
+    uint32_t u32_Start = Utils::GetMillis();
 
     Utils::WritePin(mu8_ResetPin, HIGH);
     Utils::DelayMilli(10);
@@ -123,40 +258,133 @@ void PN532::begin()
     Utils::DelayMilli(400);
     Utils::WritePin(mu8_ResetPin, HIGH);
     Utils::DelayMilli(10);  // Small delay required before taking other actions after reset. See datasheet section 12.23, page 209.
-  
-    #if (USE_HARDWARE_SPI || USE_SOFTWARE_SPI) 
-    {
-        #if USE_HARDWARE_SPI
-            SpiClass::Begin(PN532_HARD_SPI_CLOCK);
-        #endif
 
-        // Wake up the PN532 (chapter 7.2.11) -> send a sequence of 0x55 (dummy bytes)
-        byte u8_Buffer[20];
-        memset(u8_Buffer, PN532_WAKEUP, sizeof(u8_Buffer));
-        SendPacket(u8_Buffer, sizeof(u8_Buffer));
+    // The reset has stopped the auto polling
+    mb_AutoPoll = false;
+    mu8_RecoveryStep = REC_Resync;
+
+    // The reset restores the default retries. The link quality is measured anew.
+    mu8_AppliedRetries = 0xFF;
+    memset(&mk_LinkQuality, 0, sizeof(mk_LinkQuality));
+
+    // After a reset always start with the configured (slowest) clock
+    mi_Transport.SetClockStep(0);
+
+    // Start the bus and wake up the PN532
+    mi_Transport.Begin();
+
+    mk_RecoveryStats.u16_Tries [REC_Reset] ++;
+    mk_RecoveryStats.u32_Millis[REC_Reset] += Utils::GetMillis() - u32_Start;
+}
+
+/**************************************************************************
+    Tries to bring the PN532 back after a communication error without a hard reset.
+    The steps are executed from cheap to expensive until the PN532 responds again:
+    1.) ACK frame: aborts a pending command and resynchronizes the frame stream (approx 1 ms)
+    2.) Wake up sequence: the PN532 may be in PowerDown mode
+    3.) SamConfig: the PN532 may have lost its configuration
+    After each step GetFirmwareVersion() checks if the PN532 responds.
+    A PN532 that responds may still fail the operation (e.g. after losing its configuration).
+    Therefore the next Recover() starts with the step after the last successful one,
+    until the caller confirms with ResetRecovery() that the operation works again.
+    returns false if all steps have failed. Then the caller must reset the PN532 with begin()
+    and initialize it anew (this is the last step REC_Reset that takes more than 420 ms).
+    Each step is counted and timed in GetRecoveryStats().
+**************************************************************************/
+bool PN532::Recover()
+{
+    // The ACK of the first step aborts the auto polling
+    mb_AutoPoll = false;
 
-        if (mu8_DebugLevel > 1)
+    for (byte S=mu8_RecoveryStep; S<REC_Reset; S++)
+    {
+        if (RecoveryStep((eRecoveryStep)S))
         {
-            //Utils::Print("Send WakeUp packet: ");
-            //Utils::PrintHexBuf(u8_Buffer, sizeof(u8_Buffer), LF);
+            mu8_RecoveryStep = S + 1;
+            return true;
         }
     }
-    #elif USE_HARDWARE_I2C
+    mu8_RecoveryStep = REC_Resync; // begin() follows
+    return false;
+}
+
+// Executes one recovery step and checks if the PN532 responds afterwards
+bool PN532::RecoveryStep(eRecoveryStep e_Step)
+{
+    uint32_t u32_Start = Utils::GetMillis();
+    bool b_Success = true;
+    switch (e_Step)
     {
-        I2cClass::Begin();
+        case REC_Resync:
+            SendAck();
+            Utils::DelayMilli(1);
+            break;
+        case REC_WakeUp:
+            mi_Transport.WakeUp();
+            break;
+        case REC_SamConfig:
+            b_Success = SamConfig();
+            break;
+        default:
+            return false;
     }
-    #endif
+
+    // SamConfig has already proven that the PN532 responds
+    if (b_Success && e_Step != REC_SamConfig)
+    {
+        byte IC, VersionHi, VersionLo, Flags;
+        b_Success = GetFirmwareVersion(&IC, &VersionHi, &VersionLo, &Flags);
+    }
+
+    uint32_t u32_Elapsed = Utils::GetMillis() - u32_Start;
+    mk_RecoveryStats.u16_Tries [e_Step] ++;
+    mk_RecoveryStats.u32_Millis[e_Step] += u32_Elapsed;
+    if (b_Success)
+        mk_RecoveryStats.u16_Successes[e_Step] ++;
+
+    if (PN532_DEBUG(1))
+    {
+        Utils::Print("Recovery step ");
+        Utils::PrintDec(e_Step);
+        Utils::Print(b_Success ? " succeeded in " : " failed in ");
+        Utils::PrintDec(u32_Elapsed, " ms" LF);
+    }
+    return b_Success;
 }
 
 /**************************************************************************
     Enable / disable debug output to SerialClass
-    0 = Off, 1 = high level debug, 2 = low level debug (more details)
+    0 = Off, 1 = high level debug, 2 = low level debug (more details), 3 = + ACK frames
+    Only the levels up to DEBUG_LEVEL_MAX (in Utils.h) are compiled in.
 **************************************************************************/
 void PN532::SetDebugLevel(byte level)
 {
     mu8_DebugLevel = level;
 }
 
+/**************************************************************************
+    Defines the pin that is connected to P70_IRQ of the PN532 (optional).
+    The PN532 pulls this pin low as soon as it has an ACK or a response ready.
+    When this pin is defined, WaitReady() watches the pin instead of polling the status byte
+    which costs a chip select delay of 2 ms for each poll.
+    param  irq       The IRQ pin or PN532_NO_IRQ if not connected
+**************************************************************************/
+void PN532::SetIrqPin(byte u8_Irq)
+{
+    mu8_IrqPin = u8_Irq;
+    if (mu8_IrqPin != PN532_NO_IRQ)
+        Utils::SetPinMode(mu8_IrqPin, INPUT);
+}
+
+/**************************************************************************
+    Defines the card that DataExchange() and SelectCard() communicate with.
+    u8_Tg is the logical target number (1 or 2) returned by ReadPassiveTargets()
+**************************************************************************/
+void PN532::SetTarget(byte u8_Tg)
+{
+    mu8_Target = u8_Tg;
+}
+
 /**************************************************************************
     Gets the firmware version of the PN5xx chip
     returns:
@@ -168,7 +396,7 @@ void PN532::SetDebugLevel(byte level)
 **************************************************************************/
 bool PN532::GetFirmwareVersion(byte* pIcType, byte* pVersionHi, byte* pVersionLo, byte* pFlags) 
 {
-    //if (mu8_DebugLevel > 0) Utils::Print("\r\n*** GetFirmwareVersion()\r\n");
+    //if (PN532_DEBUG(1)) Utils::Print("\r\n*** GetFirmwareVersion()\r\n");
     
     mu8_PacketBuffer[0] = PN532_COMMAND_GETFIRMWAREVERSION;
     if (!SendCommandCheckAck(mu8_PacketBuffer, 1))
@@ -193,7 +421,7 @@ bool PN532::GetFirmwareVersion(byte* pIcType, byte* pVersionHi, byte* pVersionLo
 **************************************************************************/
 bool PN532::SamConfig(void)
 {
-    //if (mu8_DebugLevel > 0) Utils::Print("\r\n*** SamConfig()\r\n");
+    //if (PN532_DEBUG(1)) Utils::Print("\r\n*** SamConfig()\r\n");
   
     mu8_PacketBuffer[0] = PN532_COMMAND_SAMCONFIGURATION;
     mu8_PacketBuffer[1] = 0x01; // normal mode;
@@ -214,16 +442,40 @@ bool PN532::SamConfig(void)
 
 /**************************************************************************
     Sets the amount of reties that the PN532 tries to activate a target
+    u8_Retries = 0 -> one attempt, 0xFF -> try forever (never use this!)
+    Each retry keeps the RF field on longer when no card is present.
+    While the link is marginal (IsLinkMarginal()) ReadPassiveTargets() temporarily uses 0 retries.
 **************************************************************************/
-bool PN532::SetPassiveActivationRetries() 
+bool PN532::SetPassiveActivationRetries(byte u8_Retries) 
+{
+    //if (PN532_DEBUG(1)) Utils::Print("\r\n*** SetPassiveActivationRetries()\r\n");
+
+    mu8_ActivationRetries = u8_Retries;
+    return SendActivationRetries(u8_Retries);
+}
+
+// Sets the retries in the PN532 only if they differ from the current ones
+bool PN532::AdaptActivationRetries()
+{
+    byte u8_Retries = IsLinkMarginal() ? 0 : mu8_ActivationRetries;
+    if (u8_Retries == mu8_AppliedRetries)
+        return true;
+
+    if (PN532_DEBUG(1))
+    {
+        Utils::Print("Activation retries: ");
+        Utils::PrintDec(u8_Retries, LF);
+    }
+    return SendActivationRetries(u8_Retries);
+}
+
+bool PN532::SendActivationRetries(byte u8_Retries)
 {
-    //if (mu8_DebugLevel > 0) Utils::Print("\r\n*** SetPassiveActivationRetries()\r\n");
-  
     mu8_PacketBuffer[0] = PN532_COMMAND_RFCONFIGURATION;
     mu8_PacketBuffer[1] = 5;    // Config item 5 (MaxRetries)
     mu8_PacketBuffer[2] = 0xFF; // MxRtyATR (default = 0xFF)
     mu8_PacketBuffer[3] = 0x01; // MxRtyPSL (default = 0x01)
-    mu8_PacketBuffer[4] = 3;    // one retry is enough for Mifare Classic but Desfire is slower (if you modify this, you must also modify PN532_TIMEOUT!)
+    mu8_PacketBuffer[4] = u8_Retries; // one retry is enough for Mifare Classic but Desfire is slower (if you modify this, you must also modify PN532_TIMEOUT!)
     
     if (!SendCommandCheckAck(mu8_PacketBuffer, 5))
         return false;
@@ -234,6 +486,33 @@ bool PN532::SetPassiveActivationRetries()
         //Utils::Print("SetPassiveActivationRetries failed\r\n");
         return false;
     }
+    mu8_AppliedRetries = u8_Retries;
+    return true;
+}
+
+/**************************************************************************
+    Reads the last error, the external RF field and the count of targets (chapter 7.2.3)
+    The information about the targets and the SAM is not returned.
+**************************************************************************/
+bool PN532::GetGeneralStatus(kGeneralStatus* pk_Status)
+{
+    //if (PN532_DEBUG(1)) Utils::Print("\r\n*** GetGeneralStatus()\r\n");
+
+    mu8_PacketBuffer[0] = PN532_COMMAND_GETGENERALSTATUS;
+
+    if (!SendCommandCheckAck(mu8_PacketBuffer, 1))
+        return false;
+
+    byte len = ReadData(mu8_PacketBuffer, PN532_PACKBUFFSIZE);
+    if (len < 5 || mu8_PacketBuffer[1] != PN532_COMMAND_GETGENERALSTATUS + 1)
+    {
+        //Utils::Print("GetGeneralStatus failed\r\n");
+        return false;
+    }
+
+    pk_Status->u8_Error = mu8_PacketBuffer[2] & 0x3F;
+    pk_Status->u8_Field = mu8_PacketBuffer[3];
+    pk_Status->u8_NbTg  = mu8_PacketBuffer[4];
     return true;
 }
 
@@ -245,7 +524,7 @@ bool PN532::SetPassiveActivationRetries()
 **************************************************************************/
 bool PN532::SwitchOffRfField() 
 {
-    //if (mu8_DebugLevel > 0) Utils::Print("\r\n*** SwitchOffRfField()\r\n");
+    //if (PN532_DEBUG(1)) Utils::Print("\r\n*** SwitchOffRfField()\r\n");
   
     mu8_PacketBuffer[0] = PN532_COMMAND_RFCONFIGURATION;
     mu8_PacketBuffer[1] = 1; // Config item 1 (RF Field)
@@ -263,6 +542,51 @@ bool PN532::SwitchOffRfField()
     return true;
 }
 
+/**************************************************************************
+    Puts the PN532 into PowerDown mode (chapter 7.2.11).
+    The RF field is switched off and the board consumes only a few mA (the PN532 itself approx 10 uA).
+    Only the host interface is enabled as wake up source, so the PN532 sleeps until WakeUp() is called.
+    ATTENTION: The RF level detector (PN532_WAKEUP_RF) only detects an external RF field (smartphone, other reader).
+    A passive card has no field of its own and cannot wake up the PN532. 
+    Therefore cards are detected by waking up the PN532 periodically for a short ReadPassiveTargetID().
+    The PN532 keeps its configuration (SamConfig, RF retries) in PowerDown mode.
+**************************************************************************/
+bool PN532::PowerDown()
+{
+    //if (PN532_DEBUG(1)) Utils::Print("\r\n*** PowerDown()\r\n");
+
+    #if USE_HARDWARE_SPI || USE_SOFTWARE_SPI
+        const byte u8_WakeUpEnable = PN532_WAKEUP_SPI;
+    #elif USE_HARDWARE_I2C
+        const byte u8_WakeUpEnable = PN532_WAKEUP_I2C;
+    #else
+        const byte u8_WakeUpEnable = PN532_WAKEUP_HSU;
+    #endif
+
+    mu8_PacketBuffer[0] = PN532_COMMAND_POWERDOWN;
+    mu8_PacketBuffer[1] = u8_WakeUpEnable;
+  
+    if (!SendCommandCheckAck(mu8_PacketBuffer, 2))
+        return false;
+  
+    byte len = ReadData(mu8_PacketBuffer, 9);
+    if (len != 3 || mu8_PacketBuffer[1] != PN532_COMMAND_POWERDOWN + 1)
+    {
+        //Utils::Print("PowerDown failed\r\n");
+        return false;
+    }
+    return CheckPN532Status(mu8_PacketBuffer[2]);
+}
+
+/**************************************************************************
+    Wakes up the PN532 after PowerDown().
+    After this the PN532 accepts commands again.
+**************************************************************************/
+void PN532::WakeUp()
+{
+    mi_Transport.WakeUp();
+}
+
 /**************************************************************************/
 /*!
     Writes an 8-bit value that sets the state of the PN532's GPIO pins
@@ -289,7 +613,7 @@ bool PN532::SwitchOffRfField()
 /**************************************************************************/
 bool PN532::WriteGPIO(bool P30, bool P31, bool P33, bool P35)
 {
-    //if (mu8_DebugLevel > 0) Utils::Print("\r\n*** WriteGPIO()\r\n");
+    //if (PN532_DEBUG(1)) Utils::Print("\r\n*** WriteGPIO()\r\n");
   
     byte pinState = (P30 ? PN532_GPIO_P30 : 0) |
                     (P31 ? PN532_GPIO_P31 : 0) |
@@ -329,14 +653,51 @@ bool PN532::WriteGPIO(bool P30, bool P31, bool P33, bool P35)
 **************************************************************************/
 bool PN532::ReadPassiveTargetID(byte* u8_UidBuffer, byte* pu8_UidLength, eCardType* pe_CardType) 
 {
-    //if (mu8_DebugLevel > 0) Utils::Print("\r\n*** ReadPassiveTargetID()\r\n");
+    //if (PN532_DEBUG(1)) Utils::Print("\r\n*** ReadPassiveTargetID()\r\n");
       
     *pu8_UidLength = 0;
     *pe_CardType   = CARD_Unknown;
     memset(u8_UidBuffer, 0, 8);
+
+    kTarget k_Target;
+    byte u8_Count;
+    if (!ReadPassiveTargets(&k_Target, 1, &u8_Count))
+        return false;
+
+    if (u8_Count == 1)
+    {
+        memcpy(u8_UidBuffer, k_Target.u8_Uid, k_Target.u8_UidLength);
+        *pu8_UidLength = k_Target.u8_UidLength;
+        *pe_CardType   = k_Target.e_CardType;
+    }
+    return true;
+}
+
+/**************************************************************************
+    Waits for up to 2 ISO14443A targets in the field (e.g. two cards in a wallet).
+    If the RF field has been turned off before, this command switches it on.
+    The first target found is selected for DataExchange(). Call SetTarget() to use the other one.
+
+    param pk_Targets     Array of u8_MaxTargets elements that receives the targets
+    param u8_MaxTargets  1 or 2 (The PN532 can read max 2 targets at the same time)
+    param pu8_Count      Receives the count of targets found. 
+                         A target with an unsupported UID length has u8_UidLength = 0.
+    returns false only on error!
+**************************************************************************/
+bool PN532::ReadPassiveTargets(kTarget* pk_Targets, byte u8_MaxTargets, byte* pu8_Count) 
+{
+    *pu8_Count = 0;
+    if (u8_MaxTargets < 1 || u8_MaxTargets > 2)
+        return false;
+
+    memset(pk_Targets, 0, u8_MaxTargets * sizeof(kTarget));
+
+    // A card at the edge of the field should fail quickly instead of being retried
+    if (!AdaptActivationRetries())
+        return false;
       
     mu8_PacketBuffer[0] = PN532_COMMAND_INLISTPASSIVETARGET;
-    mu8_PacketBuffer[1] = 1;  // read data of 1 card (The PN532 can read max 2 targets at the same time)
+    mu8_PacketBuffer[1] = u8_MaxTargets;
     mu8_PacketBuffer[2] = CARD_TYPE_106KB_ISO14443A; // This function currently does not support other card types.
   
     if (!SendCommandCheckAck(mu8_PacketBuffer, 3))
@@ -349,49 +710,121 @@ bool PN532::ReadPassiveTargetID(byte* u8_UidBuffer, byte* pu8_UidLength, eCardTy
     b0               D5 (always) (PN532_PN532TOHOST)
     b1               4B (always) (PN532_COMMAND_INLISTPASSIVETARGET + 1)
     b2               Amount of cards found
-    b3               Tag number (always 1)
-    b4,5             SENS_RES (ATQA = Answer to Request Type A)
-    b6               SEL_RES  (SAK  = Select Acknowledge)
-    b7               UID Length
-    b8..Length       UID (4 or 7 bytes)
-    nn               ATS Length     (Desfire only)
-    nn..Length-1     ATS data bytes (Desfire only)
+    b3...            Target data of the first card  (see ParseTargetData())
+    nn...            Target data of the second card (see ParseTargetData())
     */ 
-    byte len = ReadData(mu8_PacketBuffer, 28);
+    // ReadData() stops reading at the end of the frame, so a large len costs no time
+    uint16_t len = ReadData(mu8_PacketBuffer, PN532_PACKBUFFSIZE);
     if (len < 3 || mu8_PacketBuffer[1] != PN532_COMMAND_INLISTPASSIVETARGET + 1)
     {
-        //Utils::Print("ReadPassiveTargetID failed\r\n");
+        //Utils::Print("ReadPassiveTargets failed\r\n");
         return false;
     }   
 
     byte cardsFound = mu8_PacketBuffer[2]; 
-    if (mu8_DebugLevel > 0)
+    if (PN532_DEBUG(1))
     {
-        //Utils::Print("Cards found: "); 
+        Utils::Print("Cards found: ");
         Utils::PrintDec(cardsFound, LF); 
     }
-    if (cardsFound != 1)
-        return true; // no card found -> this is not an error!
 
-    byte u8_IdLength = mu8_PacketBuffer[7];
+    uint16_t P = 3;
+    for (byte T=0; T<cardsFound && T<u8_MaxTargets; T++)
+    {
+        uint16_t u16_Used = ParseTargetData(mu8_PacketBuffer + P, len - P, &pk_Targets[T]);
+        if (u16_Used == 0)
+            break; // incomplete target data
+
+        StoreTargetInfo(&pk_Targets[T]);
+        P += u16_Used;
+        (*pu8_Count) ++;
+    }
+
+    if (*pu8_Count > 0)
+        SetTarget(pk_Targets[0].u8_Tg);
+
+    // The card must not receive a frame before the start-up frame guard time (SFGT) after the ATS has elapsed.
+    // Most cards have SFGI = 0 (no guard time).
+    byte u8_SFGI = 0;
+    for (byte T=0; T<*pu8_Count; T++)
+    {
+        if (pk_Targets[T].k_Ats.u8_SFGI > u8_SFGI)
+            u8_SFGI = pk_Targets[T].k_Ats.u8_SFGI;
+    }
+    if (u8_SFGI > 0)
+    {
+        uint32_t u32_SfgtMicro = 302UL << u8_SFGI;
+        if (u32_SfgtMicro < 16000) Utils::DelayMicro(u32_SfgtMicro);
+        else                       Utils::DelayMilli(u32_SfgtMicro / 1000 + 1);
+    }
+    return true;
+}
+
+/**************************************************************************
+    Parses the target data of one ISO14443A card in the response of 
+    InListPassiveTarget or InAutoPoll.
+    pu8_Data     Description
+    -------------------------------------------------------
+    b0           Logical target number (1 or 2)
+    b1,2         SENS_RES (ATQA = Answer to Request Type A)
+    b3           SEL_RES  (SAK  = Select Acknowledge)
+    b4           UID Length
+    b5..Length   UID (4 or 7 bytes)
+    nn           ATS Length     (ISO14443-4 cards only, e.g. Desfire) (the length includes this byte)
+    nn..Length-1 ATS data bytes (ISO14443-4 cards only, e.g. Desfire)
+    Sets pk_Target->u8_UidLength = 0 if the card is not supported.
+    returns the count of bytes of the target data or 0 if the data is incomplete
+**************************************************************************/
+uint16_t PN532::ParseTargetData(const byte* pu8_Data, uint16_t u16_DataLen, kTarget* pk_Target)
+{
+    memset(pk_Target, 0, sizeof(kTarget));
+    if (u16_DataLen < 5)
+        return 0;
+
+    byte u8_IdLength = pu8_Data[4];
+    byte u8_SAK      = pu8_Data[3];
+
+    uint16_t u16_Used = 5 + u8_IdLength;
+    if (u8_SAK & 0x20) // ISO14443-4 compliant -> the ATS follows
+    {
+        if (u16_DataLen <= u16_Used)
+            return 0;
+        const byte* pu8_Ats = pu8_Data + u16_Used;
+        byte u8_AtsLen = pu8_Ats[0];
+        u16_Used += (u8_AtsLen > 0) ? u8_AtsLen : 1;
+        if (u16_DataLen < u16_Used)
+            return 0;
+
+        ParseAts(pu8_Ats, u8_AtsLen, &pk_Target->k_Ats);
+    }
+    else ParseAts(NULL, 0, &pk_Target->k_Ats);
+
+    if (u16_DataLen < u16_Used)
+        return 0;
+
+    pk_Target->u8_Tg = pu8_Data[0];
     if (u8_IdLength != 4 && u8_IdLength != 7)
     {
-        //Utils::Print("Card has unsupported UID length: ");
-        Utils::PrintDec(u8_IdLength, LF); 
-        return true; // unsupported card found -> this is not an error!
+        if (PN532_DEBUG(1))
+        {
+            Utils::Print("Card has unsupported UID length: ");
+            Utils::PrintDec(u8_IdLength, LF); 
+        }
+        return u16_Used; // unsupported card found -> this is not an error!
     }   
 
-    memcpy(u8_UidBuffer, mu8_PacketBuffer + 8, u8_IdLength);    
-    *pu8_UidLength = u8_IdLength;
+    byte*      u8_UidBuffer = pk_Target->u8_Uid;
+    eCardType* pe_CardType  = &pk_Target->e_CardType;
+    memcpy(u8_UidBuffer, pu8_Data + 5, u8_IdLength);    
+    pk_Target->u8_UidLength = u8_IdLength;
 
     // See "Mifare Identification & Card Types.pdf" in the ZIP file
-    uint16_t u16_ATQA = ((uint16_t)mu8_PacketBuffer[4] << 8) | mu8_PacketBuffer[5];
-    byte     u8_SAK   = mu8_PacketBuffer[6];
+    uint16_t u16_ATQA = ((uint16_t)pu8_Data[1] << 8) | pu8_Data[2];
 
     if (u8_IdLength == 7 && u8_UidBuffer[0] != 0x80 && u16_ATQA == 0x0344 && u8_SAK == 0x20) *pe_CardType = CARD_Desfire;
     if (u8_IdLength == 4 && u8_UidBuffer[0] == 0x80 && u16_ATQA == 0x0304 && u8_SAK == 0x20) *pe_CardType = CARD_DesRandom;
     
-    if (mu8_DebugLevel > 0)
+    if (PN532_DEBUG(1))
     {
         //Utils::Print("Card UID:    ");
         Utils::PrintHexBuf(u8_UidBuffer, u8_IdLength, LF);
@@ -413,19 +846,351 @@ bool PN532::ReadPassiveTargetID(byte* u8_UidBuffer, byte* pu8_UidLength, eCardTy
             
         Utils::Print(s8_Buf, LF);
     }
+    return u16_Used;
+}
+
+/**************************************************************************
+    Parses the ATS (Answer To Select) of an ISO14443-4 card (ISO 14443-4 chapter 5.2)
+    b0    TL = length of the ATS including this byte
+    b1    T0 = bits 5,6,7: TA(1), TB(1), TC(1) are present, bits 1-4: FSCI
+    nn    TA(1) = supported bit rates
+    nn    TB(1) = bits 5-8: FWI, bits 1-4: SFGI
+    nn    TC(1) = NAD / CID support (not used)
+    nn... historical bytes
+    Values that are missing or RFU are replaced by the defaults of ISO 14443-4.
+    pu8_Ats = NULL -> the card has no ATS
+**************************************************************************/
+void PN532::ParseAts(const byte* pu8_Ats, byte u8_AtsLen, kAtsProfile* pk_Ats)
+{
+    // FSCI 0...8 -> FSC. Larger values are RFU (or too large for the PN532) -> 256
+    static const uint16_t FRAME_SIZES[] = { 16, 24, 32, 40, 48, 64, 96, 128, 256 };
+
+    memset(pk_Ats, 0, sizeof(kAtsProfile));
+    pk_Ats->u16_FrameSize = 32; // FSCI = 2
+    pk_Ats->u8_FWI        = 4;  // 4.8 ms
+
+    if (pu8_Ats == NULL || u8_AtsLen < 2)
+        return;
+
+    byte T0 = pu8_Ats[1];
+    byte u8_FSCI = T0 & 0x0F;
+    pk_Ats->u16_FrameSize = (u8_FSCI <= 8) ? FRAME_SIZES[u8_FSCI] : 256;
+
+    byte P = 2;
+    if ((T0 & 0x10) && P < u8_AtsLen) 
+        pk_Ats->u8_TA1 = pu8_Ats[P++];
+
+    if ((T0 & 0x20) && P < u8_AtsLen)
+    {
+        byte TB1 = pu8_Ats[P++];
+        if ((TB1 >> 4)   != 15) pk_Ats->u8_FWI  = TB1 >> 4;
+        if ((TB1 & 0x0F) != 15) pk_Ats->u8_SFGI = TB1 & 0x0F;
+    }
+
+    if ((T0 & 0x40) && P < u8_AtsLen) 
+        P++; // TC(1)
+
+    if (P < u8_AtsLen)
+    {
+        byte u8_Count = u8_AtsLen - P;
+        pk_Ats->u8_HistoricalLength = (u8_Count < PN532_ATS_HISTORICAL_MAX) ? u8_Count : PN532_ATS_HISTORICAL_MAX;
+        memcpy(pk_Ats->u8_Historical, pu8_Ats + P, pk_Ats->u8_HistoricalLength);
+    }
+
+    if (PN532_DEBUG(1))
+    {
+        char s8_Buf[80];
+        sprintf(s8_Buf, "ATS:         FSC= %u, FWI= %u, SFGI= %u, TA1= 0x%02X", pk_Ats->u16_FrameSize, pk_Ats->u8_FWI, pk_Ats->u8_SFGI, pk_Ats->u8_TA1);
+        Utils::Print(s8_Buf, LF);
+    }
+}
+
+// A newly activated target always starts with 106 kbps
+void PN532::StoreTargetInfo(const kTarget* pk_Target)
+{
+    if (pk_Target->u8_Tg < 1 || pk_Target->u8_Tg > 2)
+        return;
+
+    kTargetInfo* pk_Info = &mk_TargetInfo[pk_Target->u8_Tg - 1];
+    pk_Info->k_Ats      = pk_Target->k_Ats;
+    pk_Info->u8_BitRate = PN532_BITRATE_106;
+    pk_Info->b_Fallback = false;
+}
+
+// returns the info of the target selected with SetTarget()
+kTargetInfo* PN532::GetTargetInfo()
+{
+    return &mk_TargetInfo[(mu8_Target == 2) ? 1 : 0];
+}
+
+// returns the ATS parameters of the target selected with SetTarget()
+const kAtsProfile* PN532::GetAtsProfile()
+{
+    return &GetTargetInfo()->k_Ats;
+}
+
+/**************************************************************************
+    returns the time in milliseconds to wait for the response of the current target in DataExchange()
+    This is calculated from the frame waiting time (FWT) in the ATS of the card.
+    Most Desfire cards have FWI = 8 (FWT = 77 ms) -> 720 ms.
+    If the link is marginal the timeout is FWT + the measured response time.
+    The timeout is never shorter than PN532_EXCHANGE_MIN_TIMEOUT because the card may request waiting time extensions.
+**************************************************************************/
+uint16_t PN532::GetExchangeTimeout()
+{
+    uint32_t u32_FwtMicro = 302UL << GetAtsProfile()->u8_FWI;
+    uint32_t u32_Timeout;
+    if (IsLinkMarginal())
+        u32_Timeout = u32_FwtMicro / 1000 + 2 * mk_LinkQuality.u16_AvgMillis + PN532_LINK_MARGIN;
+    else
+        u32_Timeout = u32_FwtMicro * PN532_FWT_FACTOR / 1000 + PN532_EXCHANGE_MARGIN;
+
+    if (u32_Timeout < PN532_EXCHANGE_MIN_TIMEOUT)
+        return PN532_EXCHANGE_MIN_TIMEOUT;
+    return (uint16_t)u32_Timeout;
+}
+
+/**************************************************************************
+    Must be called after each exchange with a card.
+    u16_Millis = the time from sending the command until the response has been received (or the timeout)
+    u8_Status  = the status byte of the PN532 (0x01 = timeout if there was no response)
+    RF errors make the link marginal, successful exchanges make it stable again.
+**************************************************************************/
+void PN532::UpdateLinkQuality(uint16_t u16_Millis, byte u8_Status)
+{
+    u8_Status &= 0x3F;
+    mk_LinkQuality.u8_LastStatus = u8_Status;
+    mk_LinkQuality.u16_Exchanges ++;
+
+    if (IsRfError(u8_Status))
+    {
+        mk_LinkQuality.u16_Errors ++;
+        if (mk_LinkQuality.u8_ErrorLevel < 2 * PN532_LINK_MARGINAL)
+            mk_LinkQuality.u8_ErrorLevel ++;
+        return;
+    }
+
+    if (mk_LinkQuality.u8_ErrorLevel > 0)
+        mk_LinkQuality.u8_ErrorLevel --;
+
+    // Only complete exchanges say something about the response time of the card
+    if (u8_Status == 0)
+        mk_LinkQuality.u16_AvgMillis = (mk_LinkQuality.u16_AvgMillis * 3 + u16_Millis) / 4;
+}
+
+// returns true if recent exchanges had more RF errors than successes
+bool PN532::IsLinkMarginal()
+{
+    return mk_LinkQuality.u8_ErrorLevel >= PN532_LINK_MARGINAL;
+}
+
+/**************************************************************************
+    Switches the current target to the highest bit rate that the card (TA(1) in the ATS)
+    and PN532_MAX_BITRATE allow. Call this after ReadPassiveTargets() for ISO14443-4 cards (Desfire).
+    TA(1): bits 5,6,7 = card can send    with 212, 424, 848 kbps (DS)
+           bits 1,2,3 = card can receive with 212, 424, 848 kbps (DR)
+    The same bit rate is used for both directions. This also satisfies cards that set bit 8 in TA(1).
+    If errors have occurred at a higher bit rate with this card (FallbackBitRate()) it stays at 106 kbps.
+    returns true if the card stays at 106 kbps or the new bit rate has been set
+**************************************************************************/
+bool PN532::NegotiateBitRate()
+{
+    kTargetInfo* pk_Info = GetTargetInfo();
+    if (pk_Info->b_Fallback)
+        return true;
+
+    for (byte R=PN532_MAX_BITRATE; R>PN532_BITRATE_106; R--)
+    {
+        byte u8_DR = 1 << (R - 1);
+        byte u8_DS = u8_DR << 4;
+        if ((pk_Info->k_Ats.u8_TA1 & u8_DR) && (pk_Info->k_Ats.u8_TA1 & u8_DS))
+            return SetBitRate(R);
+    }
+    return true; // the card supports only 106 kbps
+}
+
+/**************************************************************************
+    Sets the bit rate of the current target in both directions with InPSL (chapter 7.3.7)
+    u8_BitRate = PN532_BITRATE_106 ... PN532_BITRATE_848
+**************************************************************************/
+bool PN532::SetBitRate(byte u8_BitRate)
+{
+    //if (PN532_DEBUG(1)) Utils::Print("\r\n*** SetBitRate()\r\n");
+
+    mu8_PacketBuffer[0] = PN532_COMMAND_INPSL;
+    mu8_PacketBuffer[1] = mu8_Target;
+    mu8_PacketBuffer[2] = u8_BitRate; // BRit: PN532 -> card
+    mu8_PacketBuffer[3] = u8_BitRate; // BRti: card  -> PN532
+
+    if (!SendCommandCheckAck(mu8_PacketBuffer, 4))
+        return false;
+
+    byte len = ReadData(mu8_PacketBuffer, 9);
+    if (len != 3 || mu8_PacketBuffer[1] != PN532_COMMAND_INPSL + 1)
+    {
+        //Utils::Print("SetBitRate failed\r\n");
+        return false;
+    }
+
+    if (!CheckPN532Status(mu8_PacketBuffer[2]))
+        return false;
+
+    GetTargetInfo()->u8_BitRate = u8_BitRate;
+    if (PN532_DEBUG(1))
+    {
+        Utils::Print("Bit rate: ");
+        Utils::PrintDec(106 << u8_BitRate, " kbps" LF);
+    }
+    return true;
+}
+
+/**************************************************************************
+    Called after an RF error in the communication with the current target.
+    If a higher bit rate is used, the target goes back to 106 kbps and 
+    NegotiateBitRate() will not raise it again for this card.
+    returns false if the bit rate could not be changed
+**************************************************************************/
+bool PN532::FallbackBitRate()
+{
+    kTargetInfo* pk_Info = GetTargetInfo();
+    if (pk_Info->u8_BitRate == PN532_BITRATE_106)
+        return true;
+
+    pk_Info->b_Fallback = true;
+    return SetBitRate(PN532_BITRATE_106);
+}
+
+/**************************************************************************
+    Checks if the ISO14443-4 card (Desfire) that has been activated last is still in the RF field.
+    Diagnose with NumTst 6 (chapter 7.2.1) sends a presence check to the card (R(NAK) block).
+    The card stays selected and authenticated. The RF field must not have been switched off since the activation.
+    This does not work with Mifare Classic cards.
+    returns false if the card has been removed (or the PN532 does not respond)
+**************************************************************************/
+bool PN532::CheckPresence()
+{
+    //if (PN532_DEBUG(1)) Utils::Print("\r\n*** CheckPresence()\r\n");
+
+    mu8_PacketBuffer[0] = PN532_COMMAND_DIAGNOSE;
+    mu8_PacketBuffer[1] = 0x06; // NumTst: Attention Request Test or ISO14443-4 card presence detection
+
+    if (!SendCommandCheckAck(mu8_PacketBuffer, 2))
+        return false;
+
+    byte len = ReadData(mu8_PacketBuffer, 9);
+    if (len != 3 || mu8_PacketBuffer[1] != PN532_COMMAND_DIAGNOSE + 1)
+    {
+        //Utils::Print("CheckPresence failed\r\n");
+        return false;
+    }
+
+    // Status 0x01 (Timeout) = the card does not respond anymore. Not an error of the PN532.
+    return (mu8_PacketBuffer[2] & 0x3F) == 0;
+}
+
+/**************************************************************************
+    Starts autonomous polling (InAutoPoll, chapter 7.3.13).
+    The PN532 searches for an ISO14443A card on its own and responds only when a card has entered the field.
+    In the meantime the host does not send any commands. CheckAutoPoll() checks if the PN532 has found a card.
+    If the IRQ pin is connected (SetIrqPin()) CheckAutoPoll() does not even need the bus for this check.
+    param u8_Period  The time between two polling cycles in units of 150 ms (1...15)
+    Any other command stops the auto polling.
+**************************************************************************/
+bool PN532::StartAutoPoll(byte u8_Period)
+{
+    //if (PN532_DEBUG(1)) Utils::Print("\r\n*** StartAutoPoll()\r\n");
+
+    mu8_PacketBuffer[0] = PN532_COMMAND_INAUTOPOLL;
+    mu8_PacketBuffer[1] = 0xFF;      // PollNr: endless polling
+    mu8_PacketBuffer[2] = u8_Period; // Period
+    mu8_PacketBuffer[3] = PN532_AUTOPOLL_GENERIC_106KB; // Generic passive 106 kbps (Mifare, ISO14443-4A, DEP)
+
+    if (!SendCommandCheckAck(mu8_PacketBuffer, 4))
+        return false;
+
+    mb_AutoPoll = true;
+    return true;
+}
+
+/**************************************************************************
+    Checks if the auto polling started with StartAutoPoll() has found a card. This function never waits.
+    After a card has been found the auto polling has ended and the card is selected for DataExchange().
+    It must be started anew after the card has been processed.
+    returns false only on error!
+    returns true and *UidLength = 0 if no card was found yet
+    returns true and *UidLength > 0 if a card has been read successfully
+**************************************************************************/
+bool PN532::CheckAutoPoll(byte* u8_UidBuffer, byte* pu8_UidLength, eCardType* pe_CardType)
+{
+    *pu8_UidLength = 0;
+    *pe_CardType   = CARD_Unknown;
+    memset(u8_UidBuffer, 0, 8);
+
+    if (!mb_AutoPoll)
+        return false; // StartAutoPoll() has not been called
+
+    bool b_Ready = (mu8_IrqPin != PN532_NO_IRQ) ? Utils::ReadPin(mu8_IrqPin) == LOW : IsReady();
+    if (!b_Ready)
+        return true;
+
+    mb_AutoPoll = false;
+
+    /* 
+    mu8_PacketBuffer Description
+    -------------------------------------------------------
+    b0               D5 (always) (PN532_PN532TOHOST)
+    b1               61 (always) (PN532_COMMAND_INAUTOPOLL + 1)
+    b2               Amount of cards found
+    b3               Target type (the type from the command)
+    b4               Length of the target data
+    b5...            Target data (see ParseTargetData())
+    */ 
+    // Two targets with 7 byte UID and ATS may be reported. ReadData() stops at the end of the frame.
+    uint16_t len = ReadData(mu8_PacketBuffer, PN532_PACKBUFFSIZE);
+    if (len < 3 || mu8_PacketBuffer[1] != PN532_COMMAND_INAUTOPOLL + 1)
+    {
+        //Utils::Print("CheckAutoPoll failed\r\n");
+        return false;
+    }   
+
+    if (mu8_PacketBuffer[2] < 1 || len < 5)
+        return true; // no card found -> this is not an error!
+
+    kTarget k_Target;
+    if (ParseTargetData(mu8_PacketBuffer + 5, len - 5, &k_Target) > 0)
+    {
+        StoreTargetInfo(&k_Target);
+        SetTarget(k_Target.u8_Tg);
+        memcpy(u8_UidBuffer, k_Target.u8_Uid, k_Target.u8_UidLength);
+        *pu8_UidLength = k_Target.u8_UidLength;
+        *pe_CardType   = k_Target.e_CardType;
+    }
     return true;
 }
 
+/**************************************************************************
+    Stops the auto polling. An ACK frame aborts the running command (chapter 6.2.1.4).
+**************************************************************************/
+void PN532::StopAutoPoll()
+{
+    if (mb_AutoPoll)
+    {
+        mb_AutoPoll = false;
+        SendAck();
+        Utils::DelayMilli(1);
+    }
+}
+
 /**************************************************************************
     The goal of this command is to select the target. (Initialization, anti-collision loop and Selection)
     If the target is already selected, no action is performed and Status OK is returned. 
 **************************************************************************/
 bool PN532::SelectCard()
 {
-    //if (mu8_DebugLevel > 0) Utils::Print("\r\n*** SelectCard()\r\n");
+    //if (PN532_DEBUG(1)) Utils::Print("\r\n*** SelectCard()\r\n");
   
     mu8_PacketBuffer[0] = PN532_COMMAND_INSELECT;
-    mu8_PacketBuffer[1] = 1; // Target 1
+    mu8_PacketBuffer[1] = mu8_Target; // Logical target number
 
     if (!SendCommandCheckAck(mu8_PacketBuffer, 2))
         return false;
@@ -451,7 +1216,7 @@ bool PN532::SelectCard()
 **************************************************************************/
 bool PN532::DeselectCard()
 {
-    //if (mu8_DebugLevel > 0) Utils::Print("\r\n*** DeselectCard()\r\n");
+    //if (PN532_DEBUG(1)) Utils::Print("\r\n*** DeselectCard()\r\n");
   
     mu8_PacketBuffer[0] = PN532_COMMAND_INDESELECT;
     mu8_PacketBuffer[1] = 0; // Deselect all cards
@@ -476,7 +1241,7 @@ bool PN532::DeselectCard()
 **************************************************************************/
 bool PN532::ReleaseCard()
 {
-    //if (mu8_DebugLevel > 0) Utils::Print("\r\n*** ReleaseCard()\r\n");
+    //if (PN532_DEBUG(1)) Utils::Print("\r\n*** ReleaseCard()\r\n");
   
     mu8_PacketBuffer[0] = PN532_COMMAND_INRELEASE;
     mu8_PacketBuffer[1] = 0; // Deselect all cards
@@ -512,11 +1277,69 @@ bool PN532::CheckPN532Status(byte u8_Status)
     if (u8_Status == 0)
         return true;
 
+    if (PN532_DEBUG(1))
+    {
+        Utils::Print("PN532 Error 0x");
+        Utils::PrintHex8(u8_Status);
+        Utils::Print(": ");
+        Utils::Print(GetStatusText(u8_Status), LF);
+    }
+    return false;
+}
+
+// returns true if the status is an error in the RF communication with the card (not an error of the PN532 or the host)
+bool PN532::IsRfError(byte u8_Status)
+{
+    switch (u8_Status & 0x3F)
+    {
+        case 0x01: // Timeout
+        case 0x02: // CRC error
+        case 0x03: // Parity error
+        case 0x04: // Erroneous bit count
+        case 0x05: // Framing error
+        case 0x06: // Abnormal bit collision
+        case 0x0B: // RF protocol error
+        case 0x2B: // Card has disappeared
+            return true;
+        default:
+            return false;
+    }
+}
 
-    switch (u8_Status)
+// The error codes of the PN532 (chapter 7.1)
+const char* PN532::GetStatusText(byte u8_Status)
+{
+    switch (u8_Status & 0x3F)
     {
-      return false;
+        case 0x00: return "Success";
+        case 0x01: return "Timeout, the card does not respond";
+        case 0x02: return "CRC error";
+        case 0x03: return "Parity error";
+        case 0x04: return "Erroneous bit count during anticollision";
+        case 0x05: return "Framing error";
+        case 0x06: return "Abnormal bit collision";
+        case 0x07: return "Communication buffer too small";
+        case 0x09: return "RF buffer overflow";
+        case 0x0A: return "RF field not switched on in time";
+        case 0x0B: return "RF protocol error";
+        case 0x0D: return "Overheating";
+        case 0x0E: return "Internal buffer overflow";
+        case 0x10: return "Invalid parameter";
+        case 0x12: return "DEP command not supported";
+        case 0x13: return "Invalid data format";
+        case 0x14: return "Mifare authentication error";
+        case 0x23: return "Wrong UID check byte";
+        case 0x25: return "Invalid device state";
+        case 0x26: return "Operation not allowed";
+        case 0x27: return "Command not acceptable in this context";
+        case 0x29: return "Target has been released";
+        case 0x2A: return "Card ID does not match";
+        case 0x2B: return "Card has disappeared";
+        case 0x2C: return "NFCID3 mismatch";
+        case 0x2D: return "Over current";
+        case 0x2E: return "NAD missing";
     }
+    return "Unknown error";
 }
 
 
@@ -530,60 +1353,42 @@ bool PN532::CheckPN532Status(byte u8_Status)
 **************************************************************************/
 bool PN532::IsReady() 
 {
-    #if (USE_HARDWARE_SPI || USE_SOFTWARE_SPI) 
-    {
-        Utils::WritePin(mu8_SselPin, LOW);
-        Utils::DelayMilli(2); // INDISPENSABLE!! Otherwise reads bullshit
-
-        //if (mu8_DebugLevel > 2) Utils::Print("IsReady(): write STATUSREAD\r\n");
-
-        SpiWrite(PN532_SPI_STATUSREAD);
-        byte u8_Ready = SpiRead();
-
-        if (mu8_DebugLevel > 2)
-        {
-            //Utils::Print("IsReady(): read ");
-            Utils::PrintHex8(u8_Ready, LF);
-        }
-    
-        Utils::WritePin(mu8_SselPin, HIGH);
-        Utils::DelayMicro(PN532_SOFT_SPI_DELAY);
-        
-        return u8_Ready == PN532_SPI_READY; // 0x01
-    }
-    #elif USE_HARDWARE_I2C
-    { 
-        // After reading this byte, the bus must be released with a Stop condition
-        I2cClass::RequestFrom((byte)PN532_I2C_ADDRESS, (byte)1);
-
-        // PN532 Manual chapter 6.2.4: Before the data bytes the chip sends a Ready byte.
-        byte u8_Ready = I2cClass::Read();
-        if (mu8_DebugLevel > 2)
-        {
-            //Utils::Print("IsReady(): read ");
-            Utils::PrintHex8(u8_Ready, LF);
-        }        
-        
-        return u8_Ready == PN532_I2C_READY; // 0x01
-    }
-    #endif
+    return mi_Transport.IsReady();
 }
 
 /**************************************************************************
     Waits until the PN532 is ready.
+    If the IRQ pin is connected the falling edge is detected immediately.
+    Otherwise (or if the IRQ line does not work) the status byte is polled.
+    u16_Timeout = maximum time in milliseconds to wait
 **************************************************************************/
-bool PN532::WaitReady() 
+bool PN532::WaitReady(uint16_t u16_Timeout) 
 {
-    uint16_t timer = 0;
+    uint32_t u32_Start = Utils::GetMillis();
+
+    if (mu8_IrqPin != PN532_NO_IRQ)
+    {
+        // SamConfig() configures the PN532 to drive the IRQ pin (which is also the default after reset)
+        while (Utils::ReadPin(mu8_IrqPin) != LOW)
+        {
+            if (Utils::GetMillis() - u32_Start >= u16_Timeout)
+            {
+                // The IRQ line may be broken -> the status byte decides
+                //Utils::Print("WaitReady() -> IRQ TIMEOUT\r\n");
+                return IsReady();
+            }
+        }
+        return true;
+    }
+
     while (!IsReady()) 
     {
-        if (timer >= PN532_TIMEOUT) 
+        if (Utils::GetMillis() - u32_Start >= u16_Timeout) 
         {
             //Utils::Print("WaitReady() -> TIMEOUT\r\n");
             return false;
         }
-        Utils::DelayMilli(10);
-        timer += 10;        
+        Utils::DelayMilli(PN532_POLL_INTERVAL);
     }
     return true;
 }
@@ -596,8 +1401,14 @@ bool PN532::WaitReady()
     returns  true  if everything is OK, 
              false if timeout occured before an ACK was recieved
 **************************************************************************/
-bool PN532::SendCommandCheckAck(byte *cmd, byte cmdlen) 
+bool PN532::SendCommandCheckAck(byte *cmd, uint16_t cmdlen) 
 {
+    if (cmdlen > PN532_PACKBUFFSIZE)
+        return false;
+
+    // A new command stops the auto polling
+    StopAutoPoll();
+
     WriteCommand(cmd, cmdlen);
     return ReadAck();
 }
@@ -606,73 +1417,84 @@ bool PN532::SendCommandCheckAck(byte *cmd, byte cmdlen)
     Writes a command to the PN532, inserting the
     preamble and required frame details (checksum, len, etc.)
 
+    The frame is built in place: If cmd is mu8_PacketBuffer (which is the case for all commands
+    in this library), the header is written into the space reserved in front of mu8_PacketBuffer
+    and the checksum and postamble are written behind the command. Nothing is copied.
+    A command in any other buffer is first moved into mu8_PacketBuffer.
+    ATTENTION: In Hardware SPI mode SendPacket() destroys the content of mu8_PacketBuffer!
+
     param  cmd       Command buffer
-    param  cmdlen    Command length in bytes
-**************************************************************************/
-void PN532::WriteCommand(byte* cmd, byte cmdlen)
-{
-    byte TxBuffer[PN532_PACKBUFFSIZE + 10];
-    int P=0;
-    TxBuffer[P++] = PN532_PREAMBLE;    // 00
-    TxBuffer[P++] = PN532_STARTCODE1;  // 00
-    TxBuffer[P++] = PN532_STARTCODE2;  // FF
-    TxBuffer[P++] = cmdlen + 1;
-    TxBuffer[P++] = 0xFF - cmdlen;
-    TxBuffer[P++] = PN532_HOSTTOPN532; // D4
-    
-    for (byte i=0; i<cmdlen; i++) 
+    param  cmdlen    Command length in bytes (max PN532_PACKBUFFSIZE)
+**************************************************************************/
+void PN532::WriteCommand(byte* cmd, uint16_t cmdlen)
+{
+    if (cmd != mu8_PacketBuffer)
+        memmove(mu8_PacketBuffer, cmd, cmdlen);
+
+    // LEN counts the TFI and the command bytes
+    uint16_t u16_Len = cmdlen + 1;
+
+    // A normal frame uses only the last 6 bytes of the header, an extended frame all 9 bytes.
+    byte u8_Header = (u16_Len > PN532_NORMAL_FRAME_MAX) ? 9 : 6;
+    byte* u8_Frame = mu8_PacketBuffer - u8_Header;
+
+    byte P=0;
+    u8_Frame[P++] = PN532_PREAMBLE;    // 00
+    u8_Frame[P++] = PN532_STARTCODE1;  // 00
+    u8_Frame[P++] = PN532_STARTCODE2;  // FF
+    if (u8_Header == 6)
     {
-        TxBuffer[P++] = cmd[i];
+        u8_Frame[P++] = (byte)u16_Len;
+        u8_Frame[P++] = (byte)(0x100 - u16_Len);
     }
+    else // extended information frame (chapter 6.2.1.3)
+    {
+        u8_Frame[P++] = 0xFF;
+        u8_Frame[P++] = 0xFF;
+        u8_Frame[P++] = (byte)(u16_Len >> 8); // LENM
+        u8_Frame[P++] = (byte)(u16_Len);      // LENL
+        u8_Frame[P++] = (byte)(0x100 - (byte)((u16_Len >> 8) + u16_Len)); // LCS: LENM + LENL + LCS = 0x00
+    }
+    u8_Frame[P++] = PN532_HOSTTOPN532; // D4
 
-    byte checksum = 0;
-    for (byte i=0; i<P; i++) 
+    // TFI + data + checksum must result in 0x00
+    byte checksum = PN532_HOSTTOPN532;
+    for (uint16_t i=0; i<cmdlen; i++) 
     {
-       checksum += TxBuffer[i];
+       checksum += mu8_PacketBuffer[i];
     }
 
-    TxBuffer[P++] = ~checksum;
-    TxBuffer[P++] = PN532_POSTAMBLE; // 00
+    mu8_PacketBuffer[cmdlen]     = ~checksum + 1;
+    mu8_PacketBuffer[cmdlen + 1] = PN532_POSTAMBLE; // 00
 
-    Utils::Print("\nSending:  ");
-    Utils::PrintHexBuf(TxBuffer, P, LF, 5, cmdlen + 6);
+    uint16_t u16_Total = u8_Header + cmdlen + PN532_FRAME_TRAILER;
+
+    if (PN532_DEBUG(2))
+    {
+        Utils::Print("\nSending:  ");
+        Utils::PrintHexBuf(u8_Frame, u16_Total, LF, u8_Header - 1, u8_Header + cmdlen);
+    }
 
-    SendPacket(TxBuffer, P);
+    SendPacket(u8_Frame, u16_Total);
 }
 
 /**************************************************************************
     Send a data packet
+    ATTENTION: In Hardware SPI mode the content of buff is destroyed!
 **************************************************************************/
-void PN532::SendPacket(byte* buff, byte len)
+void PN532::SendPacket(byte* buff, uint16_t len)
 {
-    #if (USE_HARDWARE_SPI || USE_SOFTWARE_SPI) 
-    {
-        Utils::WritePin(mu8_SselPin, LOW);
-        Utils::DelayMilli(2);  // INDISPENSABLE!!
-
-        //if (mu8_DebugLevel > 2) Utils::Print("WriteCommand(): write DATAWRITE\r\n");
-        SpiWrite(PN532_SPI_DATAWRITE);
-
-        for (byte i=0; i<len; i++) 
-        {
-            SpiWrite(buff[i]);
-        }
+    mi_Transport.Write(buff, len);
+}
 
-        Utils::WritePin(mu8_SselPin, HIGH);
-        Utils::DelayMicro(PN532_SOFT_SPI_DELAY);
-    }
-    #elif USE_HARDWARE_I2C
-    {
-        Utils::DelayMilli(2); // delay is for waking up the board
-    
-        I2cClass::BeginTransmission(PN532_I2C_ADDRESS);
-        for (byte i=0; i<len; i++) 
-        {
-            I2cClass::Write(buff[i]);
-        }   
-        I2cClass::EndTransmission();
-    }
-    #endif
+/**************************************************************************
+    Sends an ACK frame to the PN532.
+    This aborts the command that the PN532 is currently executing.
+**************************************************************************/
+void PN532::SendAck()
+{
+    byte Ack[] = {0x00, 0x00, 0xFF, 0x00, 0xFF, 0x00};
+    SendPacket(Ack, sizeof(Ack));
 }
 
 /**************************************************************************
@@ -688,7 +1510,7 @@ bool PN532::ReadAck()
     if (!ReadPacket(ackbuff, sizeof(ackbuff)))
         return false; // Timeout
 
-    if (mu8_DebugLevel > 2)
+    if (PN532_DEBUG(3))
     {
         //Utils::Print("Read ACK: ");
         Utils::PrintHexBuf(ackbuff, sizeof(ackbuff), LF);
@@ -697,242 +1519,228 @@ bool PN532::ReadAck()
     if (memcmp(ackbuff, Ack, sizeof(Ack)) != 0)
     {
         //Utils::Print("*** No ACK frame received\r\n");
+        SlowDownClock();
         return false;
     }
     return true;
 }
 
 /**************************************************************************
-    Reads n bytes of data from the PN532 via SPI or I2C and checks for valid data.
+    Reads one response frame from the PN532 and checks for valid data.
+    The bytes are passed to PN532Parser while the transport clocks them in.
+    Reading stops as soon as the frame is complete or invalid. 
+    The data bytes are written directly into buff. There is no intermediate buffer.
     param  buff      Pointer to the buffer where data will be written
-    param  len       Number of bytes to read
-    returns the number of bytes that have been copied to buff (< len) or 0 on error
+    param  len       Maximum count of bytes to read (including the frame around the data)
+    param  u16_Timeout  Maximum time in milliseconds to wait for the response (see GetExchangeTimeout())
+    returns the number of data bytes that have been copied to buff (< len) or 0 on error
+    IsReadTimeout() tells if the error was a timeout or an invalid frame / bus error.
 **************************************************************************/
-byte PN532::ReadData(byte* buff, byte len) 
+uint16_t PN532::ReadData(byte* buff, uint16_t len, uint16_t u16_Timeout) 
 { 
-    byte RxBuffer[PN532_PACKBUFFSIZE];
-        
     const byte MIN_PACK_LEN = 2 /*start bytes*/ + 2 /*length + length checksum */ + 1 /*checksum*/;
     if (len < MIN_PACK_LEN || len > PN532_PACKBUFFSIZE)
     {
         //Utils::Print("ReadData(): len is invalid\r\n");
         return 0;
     }
-    
-    if (!ReadPacket(RxBuffer, len))
-        return 0; // timeout
-
-    // The following important validity check was completely missing in Adafruit code (added by Elmü)
-    // PN532 documentation says (chapter 6.2.1.6): 
-    // Before the start code (0x00 0xFF) there may be any number of additional bytes that must be ignored.
-    // After the checksum there may be any number of additional bytes that must be ignored.
-    // This function returns ONLY the pure data bytes:
-    // any leading bytes -> skipped (never seen, but documentation says to ignore them)
-    // preamble   0x00   -> skipped (optional, the PN532 does not send it always!!!!!)
-    // start code 0x00   -> skipped
-    // start code 0xFF   -> skipped
-    // length            -> skipped
-    // length checksum   -> skipped
-    // data[0...n]       -> returned to the caller (first byte is always 0xD5)
-    // checksum          -> skipped
-    // postamble         -> skipped (optional, the PN532 may not send it!)
-    // any bytes behind  -> skipped (never seen, but documentation says to ignore them)
-
-    const char* Error = NULL;
-    int Brace1 = -1;
-    int Brace2 = -1;
-    int dataLength = 0;
-    do
-    {
-        int startCode = -1;
-        for (int i=0; i<=len-MIN_PACK_LEN; i++)
-        {
-            if (RxBuffer[i]   == PN532_STARTCODE1 && 
-                RxBuffer[i+1] == PN532_STARTCODE2)
-            {
-                startCode = i;
-                break;
-            }
-        }
 
-        if (startCode < 0)
-        {
-            //Error = "ReadData() -> No Start Code\r\n";
-            break;
-        }
-        
-        int pos = startCode + 2;
-        dataLength      = RxBuffer[pos++];
-        int lengthCheck = RxBuffer[pos++];
-        if ((dataLength + lengthCheck) != 0x100)
-        {
-            //Error = "ReadData() -> Invalid length checksum\r\n";
-            break;
-        }
-    
-        if (len < startCode + MIN_PACK_LEN + dataLength)
-        {
-            //Error = "ReadData() -> Packet is longer than requested length\r\n";
-            break;
-        }
+    mb_ReadTimeout = !WaitReady(u16_Timeout);
+    if (mb_ReadTimeout || !mi_Transport.BeginRead(len))
+        return 0; // timeout or bus error
 
-        Brace1 = pos;
-        for (int i=0; i<dataLength; i++)
-        {
-            buff[i] = RxBuffer[pos++]; // copy the pure data bytes in the packet
-        }
-        Brace2 = pos;
+    PN532Parser  i_Parser;
+    eParseResult e_Result = PARSE_More;
+    i_Parser.Begin(buff, len);
 
-        // All returned data blocks must start with PN532TOHOST (0xD5)
-        if (dataLength < 1 || buff[0] != PN532_PN532TOHOST) 
-        {
-            //Error = "ReadData() -> Invalid data (no PN532TOHOST)\r\n";
-            break;
-        }
-    
-        byte checkSum = 0;
-        for (int i=startCode; i<pos; i++)
-        {
-            checkSum += RxBuffer[i];
-        }
-    
-        if (checkSum != (byte)(~RxBuffer[pos]))
-        {
-            //Error = "ReadData() -> Invalid checksum\r\n";
+    for (uint16_t i=0; i<len && e_Result == PARSE_More; i++)
+    {
+        byte u8_Byte;
+        if (!mi_Transport.ReadByte(&u8_Byte))
             break;
-        }
-    }
-    while(false); // This is not a loop. Avoids using goto by using break.
 
-    Utils::Print("\nResponse: ");
-    Utils::PrintHexBuf(RxBuffer, len, LF, Brace1, Brace2);
- 
-    if (Error)
-    {
-        Utils::Print(Error);
-        return 0;
+        e_Result = i_Parser.Feed(u8_Byte);
     }
+    mi_Transport.EndRead();
 
-    return dataLength;
-}
-
-/**************************************************************************
-    Reads n bytes of data from the PN532 via SPI or I2C and does NOT check for valid data.
-    param  buff      Pointer to the buffer where data will be written
-    param  len       Number of bytes to read
-**************************************************************************/
-bool PN532::ReadPacket(byte* buff, byte len)
-{ 
-    if (!WaitReady())
-        return false;
-        
-    #if (USE_HARDWARE_SPI || USE_SOFTWARE_SPI) 
+    if (e_Result == PARSE_Data)
     {
-        Utils::WritePin(mu8_SselPin, LOW);
-        Utils::DelayMilli(2); // INDISPENSABLE!! Otherwise reads bullshit
-
-        //if (mu8_DebugLevel > 2)  Utils::Print("ReadPacket(): write DATAREAD\r\n");
-        SpiWrite(PN532_SPI_DATAREAD);
-    
-        for (byte i=0; i<len; i++) 
+        if (PN532_DEBUG(2))
         {
-            Utils::DelayMilli(1);
-            buff[i] = SpiRead();
+            Utils::Print("\nResponse: ");
+            Utils::PrintHexBuf(buff, i_Parser.GetDataLength(), LF);
         }
-    
-        Utils::WritePin(mu8_SselPin, HIGH);
-        Utils::DelayMicro(PN532_SOFT_SPI_DELAY);
-        return true;
+        return i_Parser.GetDataLength();
     }
-    #elif USE_HARDWARE_I2C
-    {
-        Utils::DelayMilli(2);
-    
-        // read (n+1 to take into account leading Ready byte)
-        I2cClass::RequestFrom((byte)PN532_I2C_ADDRESS, (byte)(len+1));
 
-        // PN532 Manual chapter 6.2.4: Before the data bytes the chip sends a Ready byte.
-        // It is ignored here because it has been checked already in isready()
-        byte u8_Ready = I2cClass::Read();
-        if (mu8_DebugLevel > 2)
-        {
-            //Utils::Print("ReadPacket(): read ");
-            Utils::PrintHex8(u8_Ready, LF);
-        }        
-        
-        for (byte i=0; i<len; i++) 
-        {
-            Utils::DelayMilli(1);
-            buff[i] = I2cClass::Read();
-        }
-        return true;
+    if (PN532_DEBUG(1)) 
+    {
+        Utils::Print("ReadData() -> ");
+        Utils::Print(PN532Parser::GetResultText(e_Result), LF);
     }
-    #endif
+
+    // A frame that does not fit into the caller's buffer and an ACK/NACK at the wrong time are not caused by the bus.
+    // All other errors are bit errors on the bus -> use a slower clock.
+    if (e_Result != PARSE_Overflow && e_Result != PARSE_Ack && e_Result != PARSE_Nack)
+        SlowDownClock();
+    return 0;
 }
 
+// ########################################################################
+// ####                      PN532Parser                              #####
+// ########################################################################
+
+enum eParseState
+{
+    PST_StartCode = 0, // skip any leading bytes + preamble until 0x00 0xFF
+    PST_Len,
+    PST_Lcs,
+    PST_LenM,          // extended frame
+    PST_LenL,          // extended frame
+    PST_ExtLcs,        // extended frame
+    PST_Tfi,
+    PST_Data,
+    PST_Dcs,
+    PST_ErrorDcs,      // error frame
+};
+
 /**************************************************************************
-    SPI write one byte
+    Prepares the parser for a new frame.
+    param  pu8_Buffer  receives the TFI (0xD5) and the data bytes of the frame
+    param  u16_Size    the size of pu8_Buffer
 **************************************************************************/
-void PN532::SpiWrite(byte c) 
+void PN532Parser::Begin(byte* pu8_Buffer, uint16_t u16_Size)
 {
-    #if USE_HARDWARE_SPI
-    {
-        SpiClass::Transfer(c);
-    }
-    #elif USE_SOFTWARE_SPI
-    {
-        Utils::WritePin(mu8_ClkPin, HIGH);
-        Utils::DelayMicro(PN532_SOFT_SPI_DELAY);
-    
-        for (int i=1; i<=128; i<<=1) 
-        {
-            Utils::WritePin(mu8_ClkPin, LOW);
-            Utils::DelayMicro(PN532_SOFT_SPI_DELAY);
-            
-            byte level = (c & i) ? HIGH : LOW;
-            Utils::WritePin(mu8_MosiPin, level);
-            Utils::DelayMicro(PN532_SOFT_SPI_DELAY);        
-      
-            Utils::WritePin(mu8_ClkPin, HIGH);
-            Utils::DelayMicro(PN532_SOFT_SPI_DELAY);
-        }
-    }
-    #endif
+    mpu8_Buffer = pu8_Buffer;
+    mu16_Size   = u16_Size;
+    mu16_Length = 0;
+    mu16_Count  = 0;
+    mu8_State   = PST_StartCode;
+    mu8_Prev    = 0xFF;
+    mu8_Len     = 0;
+    mu8_Sum     = 0;
 }
 
 /**************************************************************************
-    SPI read one byte
+    Processes the next byte received from the PN532.
+    PN532 documentation says (chapter 6.2.1.6): 
+    Before the start code (0x00 0xFF) there may be any number of additional bytes that must be ignored.
+    After the checksum there may be any number of additional bytes that must be ignored.
+    ACK   frame: 00 00 FF 00 FF 00
+    NACK  frame: 00 00 FF FF 00 00
+    Error frame: 00 00 FF 01 FF 7F 81 00  (the PN532 detected a syntax error in the command)
+    Normal   information frame: 00 00 FF LEN LCS                     D5 data DCS 00
+    Extended information frame: 00 00 FF FF  FF  LENM LENL LCS D5 data DCS 00
+    returns PARSE_More as long as the frame is not yet complete.
+    The postamble is not required and never read.
 **************************************************************************/
-byte PN532::SpiRead(void) 
+eParseResult PN532Parser::Feed(byte u8_Byte)
 {
-    #if USE_HARDWARE_SPI 
-    {
-        return SpiClass::Transfer(0x00);
-    }
-    #elif USE_SOFTWARE_SPI
+    switch (mu8_State)
     {
-        Utils::WritePin(mu8_ClkPin, HIGH);
-        Utils::DelayMicro(PN532_SOFT_SPI_DELAY);
-
-        int x=0;    
-        for (int i=1; i<=128; i<<=1) 
-        {
-            if (Utils::ReadPin(mu8_MisoPin)) 
+        case PST_StartCode:
+            if (mu8_Prev == PN532_STARTCODE1 && u8_Byte == PN532_STARTCODE2)
+                mu8_State = PST_Len;
+            mu8_Prev = u8_Byte;
+            return PARSE_More;
+
+        case PST_Len:
+            mu8_Len   = u8_Byte;
+            mu8_State = PST_Lcs;
+            return PARSE_More;
+
+        case PST_Lcs:
+            if (mu8_Len == 0x00 && u8_Byte == 0xFF) return PARSE_Ack;
+            if (mu8_Len == 0xFF && u8_Byte == 0x00) return PARSE_Nack;
+            if (mu8_Len == 0xFF && u8_Byte == 0xFF)
             {
-                x |= i;
+                mu8_State = PST_LenM;
+                return PARSE_More;
             }
-            Utils::WritePin(mu8_ClkPin, LOW);
-            Utils::DelayMicro(PN532_SOFT_SPI_DELAY);
-            Utils::WritePin(mu8_ClkPin, HIGH);
-            Utils::DelayMicro(PN532_SOFT_SPI_DELAY);
-        }
-        return x;
+            if ((byte)(mu8_Len + u8_Byte) != 0) return PARSE_BadLength;
+            if (mu8_Len == 0)                   return PARSE_BadTfi; // no room for the TFI
+            mu16_Length = mu8_Len;
+            mu8_State   = PST_Tfi;
+            return PARSE_More;
+
+        case PST_LenM:
+            mu8_Len   = u8_Byte; // LCS is calculated over LENM + LENL
+            mu16_Length = (uint16_t)u8_Byte << 8;
+            mu8_State = PST_LenL;
+            return PARSE_More;
+
+        case PST_LenL:
+            mu8_Len   += u8_Byte;
+            mu16_Length |= u8_Byte;
+            mu8_State = PST_ExtLcs;
+            return PARSE_More;
+
+        case PST_ExtLcs:
+            if ((byte)(mu8_Len + u8_Byte) != 0) return PARSE_BadLength;
+            if (mu16_Length == 0)               return PARSE_BadTfi;
+            mu8_State = PST_Tfi;
+            return PARSE_More;
+
+        case PST_Tfi:
+            if (u8_Byte == 0x7F && mu16_Length == 1)
+            {
+                mu8_State = PST_ErrorDcs;
+                return PARSE_More;
+            }
+            if (u8_Byte != PN532_PN532TOHOST) return PARSE_BadTfi; // All returned data blocks must start with 0xD5
+            if (mu16_Length > mu16_Size)      return PARSE_Overflow;
+            // fall through
+
+        case PST_Data:
+            mpu8_Buffer[mu16_Count++] = u8_Byte; // the TFI is stored in the first byte
+            mu8_Sum  += u8_Byte;
+            mu8_State = (mu16_Count < mu16_Length) ? PST_Data : PST_Dcs;
+            return PARSE_More;
+
+        case PST_Dcs:
+            // TFI + data + checksum must result in 0x00
+            if ((byte)(mu8_Sum + u8_Byte) != 0) return PARSE_BadChecksum;
+            return PARSE_Data;
+
+        case PST_ErrorDcs:
+            if (u8_Byte != 0x81) return PARSE_BadChecksum;
+            return PARSE_ErrorFrame;
     }
-    #else
+    return PARSE_BadLength; // never reached
+}
+
+/**************************************************************************
+    returns a description for the debug output
+**************************************************************************/
+const char* PN532Parser::GetResultText(eParseResult e_Result)
+{
+    switch (e_Result)
     {
-        return 0; // This code will never execute. Just for the compiler not to complain.
+        case PARSE_More:        return "Frame is incomplete";
+        case PARSE_Data:        return "Success";
+        case PARSE_Ack:         return "Unexpected ACK frame";
+        case PARSE_Nack:        return "Unexpected NACK frame";
+        case PARSE_ErrorFrame:  return "PN532 has sent an error frame (syntax error in command)";
+        case PARSE_BadLength:   return "Invalid length checksum";
+        case PARSE_BadTfi:      return "Invalid data (no PN532TOHOST)";
+        case PARSE_BadChecksum: return "Invalid checksum";
+        case PARSE_Overflow:    return "Packet is longer than requested length";
     }
-    #endif
+    return "";
 }
 
 
+/**************************************************************************
+    Reads n bytes of data from the PN532 and does NOT check for valid data.
+    param  buff      Pointer to the buffer where data will be written
+    param  len       Number of bytes to read
+**************************************************************************/
+bool PN532::ReadPacket(byte* buff, uint16_t len)
+{ 
+    if (!WaitReady() || !mi_Transport.BeginRead(len))
+        return false;
+
+    uint16_t u16_Count = mi_Transport.ReadBuf(buff, len);
+    mi_Transport.EndRead();
+    return u16_Count == len;
+}
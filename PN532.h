@@ -13,18 +13,89 @@
 // A value of 50 microseconds results in a clock signal of 10 kHz
 // A value of 0 results in maximum speed (depends on CPU speed).
 // This parameter is not used for hardware SPI mode.
+// This is the slowest clock. CalibrateClock() determines a faster clock if the connection allows it.
 #define PN532_SOFT_SPI_DELAY  50
 
+// The count of test commands that must succeed with a software SPI clock before it is considered to be reliable.
+#define PN532_CALIBRATE_PROBES  3
+
 // The clock (in Hertz) when using Hardware SPI mode
+// The PN532 supports an SPI clock of up to 5 MHz.
 // This parameter is not used for software SPI mode.
 #define PN532_HARD_SPI_CLOCK  1000000
 
+// The delay in microseconds between pulling the chip select low and the first clock in Hardware SPI mode.
+// The SPI timing of the PN532 datasheet requires less than one clock period. Only the wake up from
+// PowerDown needs milliseconds (the oscillator must start) and this is done in WakeUp().
+#define PN532_HARD_SPI_SETUP  10
+
+// The baudrate that SetSerialBaudRate() negotiates in HSU mode (after wake up the PN532 uses 115200 baud)
+// Valid values: 9600, 19200, 38400, 57600, 115200, 230400, 460800, 921600, 1288000
+// ATTENTION: An AVR board with 16 MHz cannot generate more than 115200 baud with an acceptable error.
+// This parameter is only used for HSU mode.
+#define PN532_HSU_BAUD  460800
+
+// The maximum time in milliseconds to wait for the next byte of a frame in HSU mode
+#define PN532_HSU_BYTE_TIMEOUT  10
+
 // The maximum time to wait for an answer from the PN532
 // Do NOT use infinite timeouts like in Adafruit code!
 #define PN532_TIMEOUT  1000
 
+// The timeout for the response of a card in DataExchange() is calculated from the frame waiting time (FWT) in the ATS:
+// FWT * PN532_FWT_FACTOR + PN532_EXCHANGE_MARGIN milliseconds.
+// The factor covers retransmissions and waiting time extensions of the card, the margin the RF transfer of the data.
+#define PN532_FWT_FACTOR       8
+#define PN532_EXCHANGE_MARGIN  100
+
+// The timeout in DataExchange() is never shorter than this (milliseconds), also when the link is marginal.
+// Slow commands (CommitTransaction, FormatPICC, large WriteData) request waiting time extensions (S(WTX))
+// that may exceed the FWT of the ATS many times.
+#define PN532_EXCHANGE_MIN_TIMEOUT  PN532_TIMEOUT
+
+// The link quality is measured with the response times and RF errors of DataExchange() (see UpdateLinkQuality()).
+// After PN532_LINK_MARGINAL RF errors more than successful exchanges the link is considered marginal:
+// Then DataExchange() waits only FWT + 2 * average response time + PN532_LINK_MARGIN milliseconds (min PN532_EXCHANGE_MIN_TIMEOUT)
+// and the PN532 does not repeat failed activations, so that errors are reported quickly.
+#define PN532_LINK_MARGINAL  2
+#define PN532_LINK_MARGIN    20
+
+// The maximum count of historical bytes from the ATS that are stored
+#define PN532_ATS_HISTORICAL_MAX  15
+
+// The highest ISO14443-4 bit rate that NegotiateBitRate() will use (PN532_BITRATE_106 ... PN532_BITRATE_848)
+// The card must support it (TA(1) in the ATS). Higher rates require a good antenna and a short distance to the card.
+#define PN532_MAX_BITRATE  PN532_BITRATE_424
+
+// The interval in milliseconds between two status reads when waiting for the PN532 without IRQ pin.
+// Each status read additionally takes 2 ms in SPI mode (chip select delay).
+#define PN532_POLL_INTERVAL  1
+
 // The packet buffer is used for sending commands and for receiving responses from the PN532
-#define PN532_PACKBUFFSIZE   80
+// Commands and responses longer than 254 bytes are transferred in extended information frames.
+// The PN532 accepts up to 264 data bytes in one frame (chapter 6.2.1.3) + 11 bytes for the frame itself.
+// Define a larger value in the compiler settings to transfer more data per frame.
+// ATTENTION: Each byte costs RAM in the PN532 object.
+#ifndef PN532_PACKBUFFSIZE
+    #define PN532_PACKBUFFSIZE   80
+#endif
+
+#if PN532_PACKBUFFSIZE > 275
+    #error "PN532_PACKBUFFSIZE must not be larger than 275"
+#endif
+
+// The frame around a command: preamble, start code (2), LEN, LCS, TFI in front and DCS, postamble behind.
+// An extended frame has 3 more bytes in front: 0xFF 0xFF in place of LEN LCS, followed by LENM, LENL, LCS.
+// WriteCommand() builds the frame in place around the command in mu8_PacketBuffer.
+#define PN532_FRAME_HEADER   9
+#define PN532_FRAME_TRAILER  2
+
+// The maximum data length (TFI + command) of a normal information frame
+#define PN532_NORMAL_FRAME_MAX  255
+
+// true if the debug output of the given level is compiled in (DEBUG_LEVEL_MAX in Utils.h) and enabled with SetDebugLevel().
+// If DEBUG_LEVEL_MAX is lower than level the condition is constant false and the compiler removes the debug code.
+#define PN532_DEBUG(level)  (DEBUG_LEVEL_MAX >= (level) && mu8_DebugLevel >= (level))
 
 // ----------------------------------------------------------------------
 
@@ -77,9 +148,21 @@
 #define PN532_SPI_DATAREAD                  (0x03)
 #define PN532_SPI_READY                     (0x01)
 
+// Pass this to SetIrqPin() if the P70_IRQ pin of the PN532 is not connected
+#define PN532_NO_IRQ                        (0xFF)
+
 #define PN532_I2C_ADDRESS                   (0x48 >> 1)
 #define PN532_I2C_READY                     (0x01)
 
+// WakeUpEnable bits for PN532_COMMAND_POWERDOWN (chapter 7.2.11)
+#define PN532_WAKEUP_INT0                   (0x01)
+#define PN532_WAKEUP_INT1                   (0x02)
+#define PN532_WAKEUP_RF                     (0x08) // RF level detector (an external RF field, e.g. a smartphone, NOT a passive card)
+#define PN532_WAKEUP_HSU                    (0x10)
+#define PN532_WAKEUP_SPI                    (0x20)
+#define PN532_WAKEUP_GPIO                   (0x40)
+#define PN532_WAKEUP_I2C                    (0x80)
+
 #define PN532_GPIO_P30                      (0x01)
 #define PN532_GPIO_P31                      (0x02)
 #define PN532_GPIO_P32                      (0x04)
@@ -94,6 +177,60 @@
 #define CARD_TYPE_106KB_ISO14443B           (0x03) // card baudrate 106 kB
 #define CARD_TYPE_106KB_JEWEL               (0x04) // card baudrate 106 kB
 
+// Bit rates for InPSL
+#define PN532_BITRATE_106                   (0x00)
+#define PN532_BITRATE_212                   (0x01)
+#define PN532_BITRATE_424                   (0x02)
+#define PN532_BITRATE_848                   (0x03)
+
+// Target type for InAutoPoll: Generic passive 106 kbps (Mifare, ISO14443-4A and DEP)
+#define PN532_AUTOPOLL_GENERIC_106KB        (0x00)
+
+// The transport classes require the defines above
+#include "PN532Transport.h"
+
+// Result of PN532Parser::Feed()
+enum eParseResult
+{
+    PARSE_More = 0,    // the frame is not yet complete
+    PARSE_Data,        // a valid information frame has been received
+    PARSE_Ack,         // ACK frame
+    PARSE_Nack,        // NACK frame
+    PARSE_ErrorFrame,  // the PN532 has detected a syntax error in the command
+    PARSE_BadLength,   // invalid length checksum
+    PARSE_BadTfi,      // the frame does not come from the PN532 (TFI is not 0xD5)
+    PARSE_BadChecksum, // invalid data checksum
+    PARSE_Overflow,    // the frame does not fit into the buffer
+};
+
+// Incremental parser for the frames received from the PN532.
+// Each byte is validated immediately when it arrives, so ReadData() can stop reading
+// as soon as a frame is complete or invalid.
+class PN532Parser
+{
+public:
+    void         Begin(byte* pu8_Buffer, uint16_t u16_Size);
+    eParseResult Feed (byte u8_Byte);
+
+    // The count of bytes in the buffer (TFI + data)
+    inline uint16_t GetDataLength() 
+    {
+        return mu16_Count;
+    }
+
+    static const char* GetResultText(eParseResult e_Result);
+
+private:
+    byte*    mpu8_Buffer;
+    uint16_t mu16_Size;
+    uint16_t mu16_Length; // LEN of the frame
+    uint16_t mu16_Count;  // bytes stored in mpu8_Buffer
+    byte     mu8_State;
+    byte     mu8_Prev;
+    byte     mu8_Len;     // length byte(s) for the length checksum
+    byte     mu8_Sum;     // data checksum
+};
+
 enum eCardType
 {
     CARD_Unknown   = 0, // Mifare Classic or other card
@@ -101,6 +238,72 @@ enum eCardType
     CARD_DesRandom = 3, // A Desfire card with 4 byte random UID  (bit 0 + 1)
 };
 
+// The steps of PN532::Recover() from cheap to expensive
+enum eRecoveryStep
+{
+    REC_Resync = 0, // ACK frame -> aborts a pending command and resynchronizes the frame stream
+    REC_WakeUp,     // wake up sequence -> the PN532 may have gone to sleep (PowerDown, HSU)
+    REC_SamConfig,  // SamConfig -> the PN532 may have lost its configuration
+    REC_Reset,      // hard reset with begin() -> the caller must initialize the PN532 anew
+    REC_COUNT,
+};
+
+// Counters and timing of the recovery steps (see PN532::Recover())
+struct kRecoveryStats
+{
+    uint16_t u16_Tries    [REC_COUNT]; // how often the step has been executed
+    uint16_t u16_Successes[REC_COUNT]; // how often the PN532 responded again after the step (not for REC_Reset)
+    uint32_t u32_Millis   [REC_COUNT]; // total time spent in the step
+};
+
+// The quality of the RF link to the card measured by DataExchange()
+struct kLinkQuality
+{
+    uint16_t u16_AvgMillis;  // average response time of the successful exchanges
+    uint16_t u16_Exchanges;  // count of exchanges
+    uint16_t u16_Errors;     // count of exchanges with an RF error (see IsRfError())
+    byte     u8_ErrorLevel;  // +1 for each RF error, -1 for each successful exchange (0 ... 2 * PN532_LINK_MARGINAL)
+    byte     u8_LastStatus;  // the last status of the PN532
+};
+
+// The response of GetGeneralStatus() (chapter 7.2.3)
+struct kGeneralStatus
+{
+    byte u8_Error; // the last error of the PN532
+    byte u8_Field; // 1 if an external RF field is present
+    byte u8_NbTg;  // the count of targets that the PN532 handles (0 = the card has gone)
+};
+
+// The ISO14443-4 parameters from the ATS of a card (ISO 14443-4 chapter 5.2)
+// Cards without ATS or without TA(1), TB(1), TC(1) get the default values of ISO 14443-4.
+struct kAtsProfile
+{
+    uint16_t u16_FrameSize;       // FSC = maximum frame size that the card accepts (from FSCI in T0)
+    byte     u8_FWI;              // Frame Waiting time Integer    (from TB(1)) FWT  = 302 us * 2^FWI
+    byte     u8_SFGI;             // Start-up Frame Guard Integer  (from TB(1)) SFGT = 302 us * 2^SFGI
+    byte     u8_TA1;              // TA(1) = supported bit rates (0 = only 106 kbps)
+    byte     u8_HistoricalLength;
+    byte     u8_Historical[PN532_ATS_HISTORICAL_MAX];
+};
+
+// A card found by ReadPassiveTargets()
+struct kTarget
+{
+    byte        u8_Tg;        // logical target number (1 or 2) for SetTarget()
+    byte        u8_Uid[8];    // UID (4 or 7 bytes)
+    byte        u8_UidLength; // 0 if the UID length is not supported
+    eCardType   e_CardType;
+    kAtsProfile k_Ats;
+};
+
+// What the PN532 class knows about the targets 1 and 2 in the field
+struct kTargetInfo
+{
+    kAtsProfile k_Ats;       // stays valid until the card is activated anew
+    byte        u8_BitRate;  // the bit rate set with InPSL (PN532_BITRATE_106 after activation)
+    bool        b_Fallback;  // true if errors occurred with a higher bit rate -> stay at 106 kbps
+};
+
 class PN532
 {
  public:
@@ -109,46 +312,122 @@ class PN532
     #if USE_SOFTWARE_SPI
         void InitSoftwareSPI(byte u8_Clk, byte u8_Miso, byte u8_Mosi, byte u8_Sel, byte u8_Reset);
     #endif
+    #if USE_SOFTWARE_SPI && !defined(PN532_CUSTOM_TRANSPORT)
+        byte GetSoftSpiDelay();
+    #endif
+    #if USE_HARDWARE_SPI
+        void InitHardwareSPI(byte u8_Sel, byte u8_Reset);
+    #endif
+    #if USE_HARDWARE_I2C
+        void InitI2C(byte u8_Reset);
+    #endif
+    #if USE_HSU
+        void InitHSU(byte u8_Reset);
+        bool SetSerialBaudRate(uint32_t u32_Baud);
+    #endif
    
     // Generic PN532 functions
     void begin();  
     void SetDebugLevel(byte level);
+    void SetIrqPin(byte u8_Irq);
+    bool CalibrateClock();
+    void SlowDownClock();
+    byte GetClockStep();
     bool SamConfig();
     bool GetFirmwareVersion(byte* pIcType, byte* pVersionHi, byte* pVersionLo, byte* pFlags);
     bool WriteGPIO(bool P30, bool P31, bool P33, bool P35);
-    bool SetPassiveActivationRetries();
+    bool SetPassiveActivationRetries(byte u8_Retries = 3);
+    bool GetGeneralStatus(kGeneralStatus* pk_Status);
+    void WakeUp();
+    bool Recover();
+    // Must be called when a card has been read successfully after Recover()
+    inline void ResetRecovery()
+    {
+        mu8_RecoveryStep = REC_Resync;
+    }
+    inline const kRecoveryStats* GetRecoveryStats()
+    {
+        return &mk_RecoveryStats;
+    }
+    void UpdateLinkQuality(uint16_t u16_Millis, byte u8_Status);
+    bool IsLinkMarginal();
+    inline const kLinkQuality* GetLinkQuality()
+    {
+        return &mk_LinkQuality;
+    }
     bool DeselectCard();
     bool ReleaseCard();
     bool SelectCard();
 
-    // This function is overridden in Desfire.cpp
+    // These functions are overridden in Desfire.cpp
     virtual bool SwitchOffRfField();
+    virtual bool PowerDown();
+    virtual void SetTarget(byte u8_Tg);
+    inline  byte GetTarget()
+    {
+        return mu8_Target;
+    }
             
     // ISO14443A functions
     bool ReadPassiveTargetID(byte* uidBuffer, byte* uidLength, eCardType* pe_CardType);
+    bool ReadPassiveTargets(kTarget* pk_Targets, byte u8_MaxTargets, byte* pu8_Count);
+    bool NegotiateBitRate();
+    bool SetBitRate(byte u8_BitRate);
+    bool FallbackBitRate();
+    bool CheckPresence();
+    const kAtsProfile* GetAtsProfile();
+    uint16_t GetExchangeTimeout();
+    bool StartAutoPoll(byte u8_Period);
+    bool CheckAutoPoll(byte* uidBuffer, byte* uidLength, eCardType* pe_CardType);
+    void StopAutoPoll();
+    inline bool IsAutoPoll() 
+    {
+        return mb_AutoPoll; 
+    }
 
     // Low Level functions
     bool CheckPN532Status(byte u8_Status);
-    bool SendCommandCheckAck(byte *cmd, byte cmdlen);    
-    byte ReadData    (byte* buff, byte len);
-    bool ReadPacket  (byte* buff, byte len);
-    void WriteCommand(byte* cmd,  byte cmdlen);
-    void SendPacket  (byte* buff, byte len);
+    static bool IsRfError(byte u8_Status);
+    static const char* GetStatusText(byte u8_Status);
+    bool SendCommandCheckAck(byte *cmd, uint16_t cmdlen);    
+    uint16_t ReadData (byte* buff, uint16_t len, uint16_t u16_Timeout = PN532_TIMEOUT);
+    inline bool IsReadTimeout() 
+    {
+        return mb_ReadTimeout; 
+    }
+    bool ReadPacket  (byte* buff, uint16_t len);
+    void WriteCommand(byte* cmd,  uint16_t cmdlen);
+    void SendPacket  (byte* buff, uint16_t len);
     bool IsReady();
-    bool WaitReady();
+    bool WaitReady(uint16_t u16_Timeout = PN532_TIMEOUT);
     bool ReadAck();
-    void SpiWrite(byte c);
-    byte SpiRead(void);
+    void SendAck();
 
-    byte mu8_DebugLevel;   // 0, 1, or 2
-    byte mu8_PacketBuffer[PN532_PACKBUFFSIZE];
+    byte  mu8_DebugLevel;   // 0, 1, 2 or 3 (limited by DEBUG_LEVEL_MAX)
+    byte* mu8_PacketBuffer; // PN532_PACKBUFFSIZE bytes inside mu8_FrameBuffer
 
  private:
-    byte mu8_ClkPin;
-    byte mu8_MisoPin;  
-    byte mu8_MosiPin;  
-    byte mu8_SselPin;  
+    PN532Transport mi_Transport; // selected at compile time (see PN532Transport.h)
+    bool RecoveryStep(eRecoveryStep e_Step);
+    bool SendActivationRetries(byte u8_Retries);
+    bool AdaptActivationRetries();
+    uint16_t ParseTargetData(const byte* pu8_Data, uint16_t u16_DataLen, kTarget* pk_Target);
+    void     ParseAts(const byte* pu8_Ats, byte u8_AtsLen, kAtsProfile* pk_Ats);
+    void     StoreTargetInfo(const kTarget* pk_Target);
+    kTargetInfo* GetTargetInfo();
+
     byte mu8_ResetPin;
+    byte mu8_IrqPin;
+    bool mb_AutoPoll; // true while InAutoPoll is running
+    bool mb_ReadTimeout; // true if the last ReadData() failed because the PN532 did not respond in time
+    byte mu8_Target;  // logical target number for DataExchange() and SelectCard()
+    kTargetInfo mk_TargetInfo[2];
+    kRecoveryStats mk_RecoveryStats;
+    byte           mu8_RecoveryStep; // the first step of the next Recover()
+    kLinkQuality   mk_LinkQuality;
+    byte mu8_ActivationRetries; // the retries set with SetPassiveActivationRetries()
+    byte mu8_AppliedRetries;    // the retries that are currently set in the PN532
+    byte mu8_FrameBuffer[PN532_FRAME_HEADER + PN532_PACKBUFFSIZE + PN532_FRAME_TRAILER];
 };
 
 #endif
@@ -0,0 +1,88 @@
+/**************************************************************************
+
+    Transport classes for the PN532 (see PN532Transport.h)
+    Only the functions that are too large to be inlined are implemented here.
+
+**************************************************************************/
+
+#include "PN532.h"
+
+#if USE_SOFTWARE_SPI
+
+// Delays in microseconds from slow to fast.
+// Step 0 is PN532_SOFT_SPI_DELAY, the following steps are the values in this table that are faster.
+static const byte SOFT_SPI_STEPS[] = { 100, 50, 20, 10, 5, 2, 1, 0 };
+
+/**************************************************************************
+    Changes the software SPI clock.
+    The delay PN532_SOFT_SPI_DELAY is made for long cables.
+    With a short cable the PN532 works reliably with a much faster clock.
+    returns false if there is no such step
+**************************************************************************/
+bool SoftSpiTransport::SetClockStep(byte u8_Step)
+{
+    byte u8_Delay = PN532_SOFT_SPI_DELAY;
+    byte u8_Count = 0;
+    for (byte S=0; S<sizeof(SOFT_SPI_STEPS) && u8_Count < u8_Step; S++)
+    {
+        if (SOFT_SPI_STEPS[S] < PN532_SOFT_SPI_DELAY)
+        {
+            u8_Delay = SOFT_SPI_STEPS[S];
+            u8_Count ++;
+        }
+    }
+
+    if (u8_Count < u8_Step)
+        return false;
+
+    mu8_Delay = u8_Delay;
+    mu8_Step  = u8_Step;
+    return true;
+}
+
+/**************************************************************************
+    SPI write one byte
+**************************************************************************/
+void SoftSpiTransport::WriteByte(byte c)
+{
+    Utils::WritePin(mu8_ClkPin, HIGH);
+    Utils::DelayMicro(mu8_Delay);
+
+    for (int i=1; i<=128; i<<=1)
+    {
+        Utils::WritePin(mu8_ClkPin, LOW);
+        Utils::DelayMicro(mu8_Delay);
+
+        byte level = (c & i) ? HIGH : LOW;
+        Utils::WritePin(mu8_MosiPin, level);
+        Utils::DelayMicro(mu8_Delay);
+
+        Utils::WritePin(mu8_ClkPin, HIGH);
+        Utils::DelayMicro(mu8_Delay);
+    }
+}
+
+/**************************************************************************
+    SPI read one byte
+**************************************************************************/
+byte SoftSpiTransport::ReadRaw()
+{
+    Utils::WritePin(mu8_ClkPin, HIGH);
+    Utils::DelayMicro(mu8_Delay);
+
+    int x=0;
+    for (int i=1; i<=128; i<<=1)
+    {
+        if (Utils::ReadPin(mu8_MisoPin))
+        {
+            x |= i;
+        }
+        Utils::WritePin(mu8_ClkPin, LOW);
+        Utils::DelayMicro(mu8_Delay);
+        Utils::WritePin(mu8_ClkPin, HIGH);
+        Utils::DelayMicro(mu8_Delay);
+    }
+    return x;
+}
+
+#endif // USE_SOFTWARE_SPI
@@ -0,0 +1,469 @@
+/**************************************************************************
+
+    Transport classes for the PN532: Software SPI, Hardware SPI, I2C and HSU.
+
+    Each class implements the same functions. PN532 uses the class selected
+    with the switches in Utils.h through the typedef PN532Transport at the end of this file.
+    The functions are resolved at compile time, so they can be inlined and there are no virtual calls.
+
+    A transport only moves bytes. The PN532 frame (start code, length, checksum) is handled in PN532.cpp.
+
+    void Begin()                  Start the bus and wake up the PN532 after a reset
+    void WakeUp()                 Wake up the PN532 from PowerDown mode (see PN532::PowerDown())
+    bool IsReady()                true if the PN532 has an ACK or a response ready
+    void Write(buff, len)         Send one complete frame
+    bool BeginRead(maxlen)        Start reading a frame of maximum maxlen bytes
+    bool ReadByte(&data)          Read the next byte of the frame (false on timeout)
+    uint16_t ReadBuf(buff, len)   Read the next len bytes of the frame, returns the count read
+    void EndRead()                Finish reading the frame
+    byte GetClockStep()           The current bus speed: 0 = configured speed, 1, 2,... = faster
+    bool SetClockStep(step)       Changes the bus speed, returns false if the step does not exist
+
+    To use your own transport (e.g. a simulated PN532 for benchmarks on a PC) define
+    PN532_CUSTOM_TRANSPORT as the name of your class and PN532_CUSTOM_TRANSPORT_H as its header file.
+    Your class must also have the Init() function that the PN532::Init...() function of the selected USE_ mode calls.
+
+**************************************************************************/
+
+#ifndef PN532_TRANSPORT_H
+#define PN532_TRANSPORT_H
+
+// This file is included by PN532.h and requires the defines made there.
+
+// -------------------------------------------------------------------------------------------------------------------
+
+#if USE_SOFTWARE_SPI
+    // Software SPI using 4 regular digital pins. The clock is created with Utils::DelayMicro()
+    class SoftSpiTransport
+    {
+    public:
+        SoftSpiTransport()
+        {
+            mu8_ClkPin  = 0;
+            mu8_MisoPin = 0;
+            mu8_MosiPin = 0;
+            mu8_SselPin = 0;
+            mu8_Delay   = PN532_SOFT_SPI_DELAY;
+            mu8_Step    = 0;
+        }
+
+        void Init(byte u8_Clk, byte u8_Miso, byte u8_Mosi, byte u8_Sel)
+        {
+            mu8_ClkPin  = u8_Clk;
+            mu8_MisoPin = u8_Miso;
+            mu8_MosiPin = u8_Mosi;
+            mu8_SselPin = u8_Sel;
+
+            Utils::SetPinMode(mu8_SselPin, OUTPUT);
+            Utils::SetPinMode(mu8_ClkPin,  OUTPUT);
+            Utils::SetPinMode(mu8_MosiPin, OUTPUT);
+            Utils::SetPinMode(mu8_MisoPin, INPUT);
+        }
+
+        void Begin()
+        {
+            WakeUp();
+        }
+
+        // Wake up the PN532 (chapter 7.2.11) -> send a sequence of 0x55 (dummy bytes)
+        // The falling edge of the chip select wakes the PN532 and the dummy bytes give the oscillator time to start.
+        void WakeUp()
+        {
+            byte u8_Buffer[20];
+            memset(u8_Buffer, PN532_WAKEUP, sizeof(u8_Buffer));
+            Write(u8_Buffer, sizeof(u8_Buffer));
+        }
+
+        inline bool IsReady()
+        {
+            Select();
+            WriteByte(PN532_SPI_STATUSREAD);
+            byte u8_Ready = ReadRaw();
+            Deselect();
+            return u8_Ready == PN532_SPI_READY; // 0x01
+        }
+
+        inline void Write(byte* buff, uint16_t len)
+        {
+            Select();
+            WriteByte(PN532_SPI_DATAWRITE);
+            for (uint16_t i=0; i<len; i++)
+            {
+                WriteByte(buff[i]);
+            }
+            Deselect();
+        }
+
+        inline bool BeginRead(uint16_t /*u16_MaxLen*/)
+        {
+            Select();
+            WriteByte(PN532_SPI_DATAREAD);
+            return true;
+        }
+
+        inline bool ReadByte(byte* pu8_Data)
+        {
+            *pu8_Data = ReadRaw();
+            return true;
+        }
+
+        inline uint16_t ReadBuf(byte* buff, uint16_t len)
+        {
+            for (uint16_t i=0; i<len; i++)
+            {
+                buff[i] = ReadRaw();
+            }
+            return len;
+        }
+
+        inline void EndRead()
+        {
+            Deselect();
+        }
+
+        inline byte GetClockStep()
+        {
+            return mu8_Step;
+        }
+
+        // returns the currently used delay in microseconds between toggeling the CLK line
+        inline byte GetDelay()
+        {
+            return mu8_Delay;
+        }
+
+        bool SetClockStep(byte u8_Step);
+
+    private:
+        inline void Select()
+        {
+            Utils::WritePin(mu8_SselPin, LOW);
+            Utils::DelayMilli(2); // INDISPENSABLE!! Otherwise reads bullshit
+        }
+        inline void Deselect()
+        {
+            Utils::WritePin(mu8_SselPin, HIGH);
+            Utils::DelayMicro(mu8_Delay);
+        }
+
+        void WriteByte(byte c);
+        byte ReadRaw();
+
+        byte mu8_ClkPin;
+        byte mu8_MisoPin;
+        byte mu8_MosiPin;
+        byte mu8_SselPin;
+        byte mu8_Delay; // clock delay in microseconds
+        byte mu8_Step;
+    };
+#endif
+
+// -------------------------------------------------------------------------------------------------------------------
+
+#if USE_HARDWARE_SPI
+    // Hardware SPI. Each frame is transferred in one SPI transaction (see SpiClass in Utils.h)
+    class HardSpiTransport
+    {
+    public:
+        HardSpiTransport()
+        {
+            mu8_SselPin = 0;
+        }
+
+        void Init(byte u8_Sel)
+        {
+            mu8_SselPin = u8_Sel;
+            Utils::SetPinMode(mu8_SselPin, OUTPUT);
+        }
+
+        // Wake up the PN532 (chapter 7.2.11) -> send a sequence of 0x55 (dummy bytes)
+        void Begin()
+        {
+            SpiClass::Begin();
+            WakeUp();
+        }
+
+        // Wake up the PN532 (chapter 7.2.11) -> send a sequence of 0x55 (dummy bytes)
+        // The falling chip select wakes the PN532, so here the oscillator gets 2 ms before the first clock.
+        void WakeUp()
+        {
+            byte u8_Buffer[20];
+            memset(u8_Buffer, PN532_WAKEUP, sizeof(u8_Buffer));
+            SpiClass::BeginTransaction(PN532_HARD_SPI_CLOCK);
+            Utils::WritePin(mu8_SselPin, LOW);
+            Utils::DelayMilli(2);
+            SpiClass::Transfer(PN532_SPI_DATAWRITE);
+            SpiClass::Transfer(u8_Buffer, sizeof(u8_Buffer));
+            Deselect();
+            Utils::DelayMilli(2); // the oscillator needs up to 2 ms to start
+        }
+
+        inline bool IsReady()
+        {
+            Select();
+            SpiClass::Transfer(PN532_SPI_STATUSREAD);
+            byte u8_Ready = SpiClass::Transfer(0x00);
+            Deselect();
+            return u8_Ready == PN532_SPI_READY; // 0x01
+        }
+
+        // ATTENTION: The content of buff is destroyed!
+        // The entire frame is clocked out in one transfer and the buffer receives the (meaningless) bytes from MISO.
+        inline void Write(byte* buff, uint16_t len)
+        {
+            Select();
+            SpiClass::Transfer(PN532_SPI_DATAWRITE);
+            SpiClass::Transfer(buff, len);
+            Deselect();
+        }
+
+        inline bool BeginRead(uint16_t /*u16_MaxLen*/)
+        {
+            Select();
+            SpiClass::Transfer(PN532_SPI_DATAREAD);
+            return true;
+        }
+
+        inline bool ReadByte(byte* pu8_Data)
+        {
+            *pu8_Data = SpiClass::Transfer(0x00);
+            return true;
+        }
+
+        inline uint16_t ReadBuf(byte* buff, uint16_t len)
+        {
+            // The PN532 ignores MOSI while sending the response. Clock out zeroes.
+            memset(buff, 0, len);
+            SpiClass::Transfer(buff, len);
+            return len;
+        }
+
+        inline void EndRead()
+        {
+            Deselect();
+        }
+
+        inline byte GetClockStep()
+        {
+            return 0;
+        }
+
+        inline bool SetClockStep(byte u8_Step)
+        {
+            return u8_Step == 0;
+        }
+
+    private:
+        inline void Select()
+        {
+            SpiClass::BeginTransaction(PN532_HARD_SPI_CLOCK);
+            Utils::WritePin(mu8_SselPin, LOW);
+            Utils::DelayMicro(PN532_HARD_SPI_SETUP);
+        }
+        inline void Deselect()
+        {
+            Utils::WritePin(mu8_SselPin, HIGH);
+            SpiClass::EndTransaction();
+        }
+
+        byte mu8_SselPin;
+    };
+#endif
+
+// -------------------------------------------------------------------------------------------------------------------
+
+#if USE_HARDWARE_I2C
+    // Hardware I2C (see I2cClass in Utils.h)
+    class I2cTransport
+    {
+    public:
+        void Begin()
+        {
+            I2cClass::Begin();
+        }
+
+        // The PN532 wakes up when it detects its address on the bus.
+        // It does not acknowledge this first transmission. The oscillator needs up to 2 ms to start.
+        void WakeUp()
+        {
+            I2cClass::BeginTransmission(PN532_I2C_ADDRESS);
+            I2cClass::EndTransmission();
+            Utils::DelayMilli(2);
+        }
+
+        inline bool IsReady()
+        {
+            // After reading this byte, the bus must be released with a Stop condition
+            I2cClass::RequestFrom((byte)PN532_I2C_ADDRESS, (byte)1);
+
+            // PN532 Manual chapter 6.2.4: Before the data bytes the chip sends a Ready byte.
+            return I2cClass::Read() == PN532_I2C_READY; // 0x01
+        }
+
+        inline void Write(byte* buff, uint16_t len)
+        {
+            Utils::DelayMilli(2); // delay is for waking up the board
+
+            I2cClass::BeginTransmission(PN532_I2C_ADDRESS);
+            for (uint16_t i=0; i<len; i++)
+            {
+                I2cClass::Write(buff[i]);
+            }
+            I2cClass::EndTransmission();
+        }
+
+        // The Wire library must know the count of bytes before the transfer starts.
+        // Surplus bytes behind the frame stay in the buffer of the Wire library.
+        // ATTENTION: The Wire library cannot request more than 255 bytes (on AVR even only 32 bytes).
+        // Extended frames that are longer will be incomplete in I2C mode.
+        inline bool BeginRead(uint16_t u16_MaxLen)
+        {
+            Utils::DelayMilli(2);
+
+            // read (n+1 to take into account leading Ready byte)
+            I2cClass::RequestFrom((byte)PN532_I2C_ADDRESS, (byte)(u16_MaxLen < 255 ? u16_MaxLen + 1 : 255));
+
+            // PN532 Manual chapter 6.2.4: Before the data bytes the chip sends a Ready byte.
+            // It is ignored here because it has been checked already in IsReady()
+            I2cClass::Read();
+            return true;
+        }
+
+        // The bytes are already in the buffer of the Wire library -> no delay required
+        inline bool ReadByte(byte* pu8_Data)
+        {
+            *pu8_Data = I2cClass::Read();
+            return true;
+        }
+
+        inline uint16_t ReadBuf(byte* buff, uint16_t len)
+        {
+            for (uint16_t i=0; i<len; i++)
+            {
+                buff[i] = I2cClass::Read();
+            }
+            return len;
+        }
+
+        inline void EndRead()
+        {
+        }
+
+        inline byte GetClockStep()
+        {
+            return 0;
+        }
+
+        inline bool SetClockStep(byte u8_Step)
+        {
+            return u8_Step == 0;
+        }
+    };
+#endif
+
+// -------------------------------------------------------------------------------------------------------------------
+
+#if USE_HSU
+    // High Speed UART (see HsuClass in Utils.h)
+    class HsuTransport
+    {
+    public:
+        // After a reset the PN532 always uses 115200 baud
+        void Begin()
+        {
+            HsuClass::Begin(115200);
+            WakeUp();
+        }
+
+        // Wake up the PN532 (chapter 7.2.11) -> send 0x55 0x55 followed by a long preamble of zeroes
+        // This uses the current baudrate. PowerDown mode does not change the baudrate.
+        void WakeUp()
+        {
+            byte u8_Buffer[16] = { PN532_WAKEUP, PN532_WAKEUP };
+            Write(u8_Buffer, sizeof(u8_Buffer));
+        }
+
+        // In HSU mode the PN532 sends the response without handshake
+        inline bool IsReady()
+        {
+            return HsuClass::Available() > 0;
+        }
+
+        inline void Write(byte* buff, uint16_t len)
+        {
+            // Bytes that are still in the receive buffer belong to an aborted command and would be mistaken for the response
+            while (HsuClass::Available() > 0)
+            {
+                HsuClass::Read();
+            }
+
+            HsuClass::Write(buff, len);
+            HsuClass::Flush();
+        }
+
+        inline bool BeginRead(uint16_t /*u16_MaxLen*/)
+        {
+            return true;
+        }
+
+        // The byte may not yet have arrived -> wait max PN532_HSU_BYTE_TIMEOUT.
+        inline bool ReadByte(byte* pu8_Data)
+        {
+            uint32_t u32_Start = Utils::GetMillis();
+            while (HsuClass::Available() == 0)
+            {
+                if (Utils::GetMillis() - u32_Start >= PN532_HSU_BYTE_TIMEOUT)
+                    return false;
+            }
+            *pu8_Data = HsuClass::Read();
+            return true;
+        }
+
+        inline uint16_t ReadBuf(byte* buff, uint16_t len)
+        {
+            uint16_t i=0;
+            while (i < len && ReadByte(buff + i))
+            {
+                i++;
+            }
+            return i;
+        }
+
+        inline void EndRead()
+        {
+        }
+
+        inline byte GetClockStep()
+        {
+            return 0;
+        }
+
+        inline bool SetClockStep(byte u8_Step)
+        {
+            return u8_Step == 0;
+        }
+
+        // Called by PN532::SetSerialBaudRate() after the PN532 has switched
+        inline void SetBaudRate(uint32_t u32_Baud)
+        {
+            HsuClass::Begin(u32_Baud);
+        }
+    };
+#endif
+
+// -------------------------------------------------------------------------------------------------------------------
+
+#if defined(PN532_CUSTOM_TRANSPORT)
+    #include PN532_CUSTOM_TRANSPORT_H
+    typedef PN532_CUSTOM_TRANSPORT PN532Transport;
+#elif USE_SOFTWARE_SPI
+    typedef SoftSpiTransport PN532Transport;
+#elif USE_HARDWARE_SPI
+    typedef HardSpiTransport PN532Transport;
+#elif USE_HARDWARE_I2C
+    typedef I2cTransport PN532Transport;
+#elif USE_HSU
+    typedef HsuTransport PN532Transport;
+#endif
+
+#endif // PN532_TRANSPORT_H
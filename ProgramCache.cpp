@@ -0,0 +1,220 @@
+/**************************************************************************
+
+    class ProgramCache: Keeps APDU programs identified by their hash (see ProgramCache.h)
+
+    EEPROM layout:
+    [Magic] [Active hash (4)] and for each slot: [Hash (4)] [Length] [Script (SCRIPT_MAX_SIZE)]
+
+**************************************************************************/
+
+#include "ProgramCache.h"
+
+#if USE_PROGRAM_EEPROM
+    #include <EEPROM.h>
+
+    #define PROGRAM_EEPROM_MAGIC  0x50 // 'P'
+    #define PROGRAM_EEPROM_SLOT   (PROGRAM_EEPROM_START + 5)
+    #define PROGRAM_SLOT_SIZE     (5 + SCRIPT_MAX_SIZE)
+
+    static uint32_t ReadUint32(int s32_Addr)
+    {
+        uint32_t u32_Data = 0;
+        for (int i=3; i>=0; i--)
+        {
+            u32_Data = (u32_Data << 8) | EEPROM.read(s32_Addr + i);
+        }
+        return u32_Data;
+    }
+
+    // EEPROM.update() writes only the bytes that have changed
+    static void WriteUint32(int s32_Addr, uint32_t u32_Data)
+    {
+        for (int i=0; i<4; i++)
+        {
+            EEPROM.update(s32_Addr + i, (byte)(u32_Data >> (8 * i)));
+        }
+    }
+#endif
+
+ProgramCache::ProgramCache()
+{
+    for (byte S=0; S<PROGRAM_CACHE_SLOTS; S++)
+    {
+        mk_Programs[S].u8_Length   = 0;
+        mk_Programs[S].u16_LastUse = 0;
+    }
+    mu32_Active     = 0;
+    mu16_UseCounter = 0;
+}
+
+// The hash 0 is reserved for "no program"
+uint32_t ProgramCache::CalcHash(const byte* u8_Script, int s32_Length)
+{
+    uint32_t u32_Hash = Utils::CalcCrc32(u8_Script, s32_Length);
+    return (u32_Hash == 0) ? 1 : u32_Hash;
+}
+
+/**************************************************************************
+    Loads the programs from the EEPROM (does nothing without USE_PROGRAM_EEPROM).
+    Programs whose hash does not match are discarded.
+**************************************************************************/
+void ProgramCache::Begin()
+{
+    #if USE_PROGRAM_EEPROM
+        if (EEPROM.read(PROGRAM_EEPROM_START) != PROGRAM_EEPROM_MAGIC)
+            return; // EEPROM has never been written by the cache
+
+        for (byte S=0; S<PROGRAM_CACHE_SLOTS; S++)
+        {
+            kProgram* pk_Prog = &mk_Programs[S];
+            int s32_Addr = PROGRAM_EEPROM_SLOT + S * PROGRAM_SLOT_SIZE;
+
+            pk_Prog->u32_Hash  = ReadUint32(s32_Addr);
+            pk_Prog->u8_Length = EEPROM.read(s32_Addr + 4);
+            if (pk_Prog->u8_Length > SCRIPT_MAX_SIZE)
+            {
+                pk_Prog->u8_Length = 0;
+                continue;
+            }
+
+            for (int i=0; i<pk_Prog->u8_Length; i++)
+            {
+                pk_Prog->u8_Script[i] = EEPROM.read(s32_Addr + 5 + i);
+            }
+
+            if (pk_Prog->u8_Length > 0 && CalcHash(pk_Prog->u8_Script, pk_Prog->u8_Length) != pk_Prog->u32_Hash)
+            {
+                //Utils::Print("Invalid program in EEPROM\r\n");
+                pk_Prog->u8_Length = 0;
+            }
+        }
+
+        uint32_t u32_Active = ReadUint32(PROGRAM_EEPROM_START + 1);
+        if (FindSlot(u32_Active) >= 0)
+            mu32_Active = u32_Active;
+    #endif
+}
+
+// returns the slot of the program or -1 if not in the cache
+int ProgramCache::FindSlot(uint32_t u32_Hash)
+{
+    for (byte S=0; S<PROGRAM_CACHE_SLOTS; S++)
+    {
+        if (mk_Programs[S].u8_Length > 0 && mk_Programs[S].u32_Hash == u32_Hash)
+            return S;
+    }
+    return -1;
+}
+
+/**************************************************************************
+    Stores a program and makes it the active program.
+    If the cache is full, the program that has not been used for the longest time is replaced.
+    returns the hash of the program or 0 on error
+**************************************************************************/
+uint32_t ProgramCache::Store(const byte* u8_Script, int s32_Length)
+{
+    if (s32_Length <= 0 || s32_Length > SCRIPT_MAX_SIZE)
+        return 0;
+
+    uint32_t u32_Hash = CalcHash(u8_Script, s32_Length);
+    int S = FindSlot(u32_Hash);
+    if (S < 0)
+    {
+        // Use an empty slot or replace the oldest program
+        S = 0;
+        for (byte i=0; i<PROGRAM_CACHE_SLOTS; i++)
+        {
+            if (mk_Programs[i].u8_Length == 0)
+            {
+                S = i;
+                break;
+            }
+            if ((uint16_t)(mu16_UseCounter - mk_Programs[i].u16_LastUse) > (uint16_t)(mu16_UseCounter - mk_Programs[S].u16_LastUse))
+                S = i;
+        }
+
+        kProgram* pk_Prog = &mk_Programs[S];
+        pk_Prog->u32_Hash  = u32_Hash;
+        pk_Prog->u8_Length = s32_Length;
+        memcpy(pk_Prog->u8_Script, u8_Script, s32_Length);
+        SaveSlot(S);
+    }
+
+    // A program that the server sends again is the most recently used one
+    mk_Programs[S].u16_LastUse = ++mu16_UseCounter;
+
+    SetActive(u32_Hash);
+    return u32_Hash;
+}
+
+// Removes a program which the server has invalidated
+bool ProgramCache::Remove(uint32_t u32_Hash)
+{
+    int S = FindSlot(u32_Hash);
+    if (S < 0)
+        return false;
+
+    mk_Programs[S].u8_Length = 0;
+    SaveSlot(S);
+
+    if (mu32_Active == u32_Hash)
+    {
+        mu32_Active = 0;
+        SaveActive();
+    }
+    return true;
+}
+
+// Selects the program that is executed for each new card
+bool ProgramCache::SetActive(uint32_t u32_Hash)
+{
+    if (u32_Hash != 0 && FindSlot(u32_Hash) < 0)
+        return false;
+
+    if (mu32_Active != u32_Hash)
+    {
+        mu32_Active = u32_Hash;
+        SaveActive();
+    }
+    return true;
+}
+
+/**************************************************************************
+    Loads a cached program into pi_Script
+    returns false if the program is not in the cache
+**************************************************************************/
+bool ProgramCache::LoadScript(uint32_t u32_Hash, ApduScript* pi_Script)
+{
+    int S = FindSlot(u32_Hash);
+    if (S < 0)
+        return false;
+
+    mk_Programs[S].u16_LastUse = ++mu16_UseCounter;
+    return pi_Script->Load(mk_Programs[S].u8_Script, mk_Programs[S].u8_Length);
+}
+
+void ProgramCache::SaveSlot(byte u8_Slot)
+{
+    #if USE_PROGRAM_EEPROM
+        kProgram* pk_Prog = &mk_Programs[u8_Slot];
+        int s32_Addr = PROGRAM_EEPROM_SLOT + u8_Slot * PROGRAM_SLOT_SIZE;
+
+        EEPROM.update(PROGRAM_EEPROM_START, PROGRAM_EEPROM_MAGIC);
+        WriteUint32(s32_Addr, pk_Prog->u32_Hash);
+        EEPROM.update(s32_Addr + 4, pk_Prog->u8_Length);
+        for (int i=0; i<pk_Prog->u8_Length; i++)
+        {
+            EEPROM.update(s32_Addr + 5 + i, pk_Prog->u8_Script[i]);
+        }
+    #else
+        (void)u8_Slot; // the programs are only in RAM
+    #endif
+}
+
+void ProgramCache::SaveActive()
+{
+    #if USE_PROGRAM_EEPROM
+        EEPROM.update(PROGRAM_EEPROM_START, PROGRAM_EEPROM_MAGIC);
+        WriteUint32(PROGRAM_EEPROM_START + 1, mu32_Active);
+    #endif
+}
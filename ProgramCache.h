@@ -0,0 +1,73 @@
+/**************************************************************************
+
+    class ProgramCache: Keeps APDU programs (scripts, see ApduScript.h) that the server runs on every card.
+    A program is identified by the CRC32 of its binary script (the hash).
+
+    The server sends a program once (code "PROGRAM"). It becomes the active program.
+    When the next card is detected the active program is executed immediately and only the results
+    are sent with the first request together with the hash of the program.
+    The server either continues with these results (this confirms the program)
+    or answers "INVALID" -> the program is removed and the transaction starts without a program.
+
+    Optionally the programs are stored in the EEPROM, so they survive a power loss.
+    The hash is verified when loading from the EEPROM.
+
+**************************************************************************/
+
+#ifndef PROGRAMCACHE_H
+#define PROGRAMCACHE_H
+
+#include "ApduScript.h"
+
+// The count of programs kept in RAM (each needs SCRIPT_MAX_SIZE + 7 bytes)
+#ifndef PROGRAM_CACHE_SLOTS
+    #define PROGRAM_CACHE_SLOTS   2
+#endif
+
+// true -> the programs are also stored in the EEPROM (requires 5 + PROGRAM_CACHE_SLOTS * (SCRIPT_MAX_SIZE + 5) bytes)
+#ifndef USE_PROGRAM_EEPROM
+    #define USE_PROGRAM_EEPROM    false
+#endif
+
+// The first EEPROM address used by the cache
+#ifndef PROGRAM_EEPROM_START
+    #define PROGRAM_EEPROM_START  0
+#endif
+
+struct kProgram
+{
+    uint32_t u32_Hash;
+    byte     u8_Length;    // 0 = empty slot
+    uint16_t u16_LastUse;  // the program that has not been used for the longest time is replaced first
+    byte     u8_Script[SCRIPT_MAX_SIZE];
+};
+
+class ProgramCache
+{
+public:
+    ProgramCache();
+    void     Begin();
+    uint32_t Store(const byte* u8_Script, int s32_Length);
+    bool     Remove(uint32_t u32_Hash);
+    bool     LoadScript(uint32_t u32_Hash, ApduScript* pi_Script);
+    bool     SetActive(uint32_t u32_Hash);
+
+    // The hash of the program that is executed for each new card (0 = none)
+    inline uint32_t GetActive()
+    {
+        return mu32_Active;
+    }
+
+    static uint32_t CalcHash(const byte* u8_Script, int s32_Length);
+
+private:
+    int  FindSlot(uint32_t u32_Hash);
+    void SaveSlot(byte u8_Slot);
+    void SaveActive();
+
+    kProgram mk_Programs[PROGRAM_CACHE_SLOTS];
+    uint32_t mu32_Active;
+    uint16_t mu16_UseCounter;
+};
+
+#endif // PROGRAMCACHE_H
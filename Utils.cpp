@@ -7,6 +7,50 @@
 
 #include "Utils.h"
 
+#if USE_LOG_BUFFER
+
+static char     s8_LogBuffer[LOG_BUFFER_SIZE];
+static uint16_t u16_LogHead   = 0;     // the position where Print() writes the next character
+static uint16_t u16_LogTail   = 0;     // the position where Drain() reads the next character
+static bool      b_LogOverflow = false; // text has been discarded
+
+// Stores the text in the ring buffer. Never waits.
+void SerialClass::Print(const char* s8_Text)
+{
+    for (; *s8_Text; s8_Text++)
+    {
+        uint16_t u16_Next = (u16_LogHead + 1) % LOG_BUFFER_SIZE;
+        if (u16_Next == u16_LogTail)
+        {
+            b_LogOverflow = true;
+            return;
+        }
+        s8_LogBuffer[u16_LogHead] = *s8_Text;
+        u16_LogHead = u16_Next;
+    }
+}
+
+// Sends only as many characters as fit into the transmit buffer of the serial port. Never waits.
+void SerialClass::Drain()
+{
+    int s32_Free = Serial.availableForWrite();
+    while (s32_Free > 0 && u16_LogTail != u16_LogHead)
+    {
+        Serial.write((byte)s8_LogBuffer[u16_LogTail]);
+        u16_LogTail = (u16_LogTail + 1) % LOG_BUFFER_SIZE;
+        s32_Free --;
+    }
+
+    // Report the lost text after everything before it has been sent
+    if (b_LogOverflow && u16_LogTail == u16_LogHead)
+    {
+        b_LogOverflow = false;
+        Print("\r\n*** Log buffer overflow: Debug output was lost. Increase LOG_BUFFER_SIZE.\r\n");
+    }
+}
+
+#endif // USE_LOG_BUFFER
+
 // Utils::Print("Hello World", LF); --> prints "Hello World\r\n"
 void Utils::Print(const char* s8_Text, const char* s8_LF) //=NULL
 {
@@ -143,6 +187,62 @@ void Utils::GenerateRandom(byte* u8_Random, int s32_Length)
     }
 }
 
+// ---------------------------------------------------------------------------------
+// The CRC lookup tables are calculated by the compiler (constexpr), so they cannot contain typing errors.
+// These functions are only executed at compile time.
+
+// Processes u8_Bits bits of the reflected CRC32 (polynomial 0xEDB88320)
+static constexpr uint32_t Crc32Bits(uint32_t u32_Crc, byte u8_Bits)
+{
+    return u8_Bits == 0 ? u32_Crc : Crc32Bits((u32_Crc >> 1) ^ ((u32_Crc & 1) ? 0xEDB88320 : 0), u8_Bits - 1);
+}
+
+// Processes a zero terminated string with the bitwise CRC (only for the check below)
+static constexpr uint32_t Crc32String(const char* s8_Text, uint32_t u32_Crc)
+{
+    return *s8_Text == 0 ? u32_Crc : Crc32String(s8_Text + 1, Crc32Bits(u32_Crc ^ (byte)*s8_Text, 8));
+}
+
+// The standard check value of CRC-32 for "123456789" is 0xCBF43926 (with final XOR)
+static_assert(Crc32String("123456789", 0xFFFFFFFF) == ~0xCBF43926, "CRC32 generator is wrong");
+static_assert(Crc32Bits(0x01, 8) == 0x77073096 && Crc32Bits(0xFF, 8) == 0x2D02EF8D, "CRC32 table is wrong");
+
+#define CRC_ROW16(F, K, N)  F(N+0x0,K), F(N+0x1,K), F(N+0x2,K), F(N+0x3,K), F(N+0x4,K), F(N+0x5,K), F(N+0x6,K), F(N+0x7,K), \
+                            F(N+0x8,K), F(N+0x9,K), F(N+0xA,K), F(N+0xB,K), F(N+0xC,K), F(N+0xD,K), F(N+0xE,K), F(N+0xF,K)
+
+#if USE_CRC_SLICE_BY_8
+
+    #define CRC_TABLE256(F, K)  { CRC_ROW16(F,K,0x00), CRC_ROW16(F,K,0x10), CRC_ROW16(F,K,0x20), CRC_ROW16(F,K,0x30), \
+                                  CRC_ROW16(F,K,0x40), CRC_ROW16(F,K,0x50), CRC_ROW16(F,K,0x60), CRC_ROW16(F,K,0x70), \
+                                  CRC_ROW16(F,K,0x80), CRC_ROW16(F,K,0x90), CRC_ROW16(F,K,0xA0), CRC_ROW16(F,K,0xB0), \
+                                  CRC_ROW16(F,K,0xC0), CRC_ROW16(F,K,0xD0), CRC_ROW16(F,K,0xE0), CRC_ROW16(F,K,0xF0) }
+
+    // Shifts a CRC by u8_Bytes zero bytes
+    static constexpr uint32_t Crc32Zeros(uint32_t u32_Crc, byte u8_Bytes)
+    {
+        return u8_Bytes == 0 ? u32_Crc : Crc32Zeros((u32_Crc >> 8) ^ Crc32Bits(u32_Crc & 0xFF, 8), u8_Bytes - 1);
+    }
+    // Table K = the CRC of byte N followed by K zero bytes
+    static constexpr uint32_t Crc32Slice(uint32_t N, byte K)
+    {
+        return Crc32Zeros(Crc32Bits(N, 8), K);
+    }
+
+    static constexpr uint32_t CRC32_TABLE[8][256] = 
+    {
+        CRC_TABLE256(Crc32Slice, 0), CRC_TABLE256(Crc32Slice, 1), CRC_TABLE256(Crc32Slice, 2), CRC_TABLE256(Crc32Slice, 3),
+        CRC_TABLE256(Crc32Slice, 4), CRC_TABLE256(Crc32Slice, 5), CRC_TABLE256(Crc32Slice, 6), CRC_TABLE256(Crc32Slice, 7)
+    };
+
+    static_assert(CRC32_TABLE[0][0x80] == 0xEDB88320 && CRC32_TABLE[1][0x01] == 0x191B3141, "CRC32 slice table is wrong");
+
+#else // AVR: 4 bit table in flash memory
+
+    // Entry N = the CRC of the 4 bits N
+    static const uint32_t CRC32_NIBBLE[16] PROGMEM = { CRC_ROW16(Crc32Bits, 4, 0) };
+
+#endif
+
 // ITU-V.41 (ISO 14443A)
 // This CRC is used only for legacy authentication. (not implemented anymore)
 uint16_t Utils::CalcCrc16(const byte* u8_Data, int s32_Length)
@@ -173,16 +273,28 @@ uint32_t Utils::CalcCrc32(const byte* u8_Data1, int s32_Length1, // data to proc
 // private
 uint32_t Utils::CalcCrc32(const byte* u8_Data, int s32_Length, uint32_t u32_Crc)
 {
-    for (int i=0; i<s32_Length; i++)
-    {
-        u32_Crc ^= u8_Data[i];
-        for (int b=0; b<8; b++)
+    #if USE_CRC_SLICE_BY_8
+        // 8 bytes per step. The bytes are combined without pointer casts, so the byte order of the processor does not matter.
+        const uint32_t (*T)[256] = CRC32_TABLE;
+        for (; s32_Length >= 8; s32_Length -= 8, u8_Data += 8)
         {
-            bool b_Bit = (u32_Crc & 0x01) > 0;
-            u32_Crc >>= 1;
-            if (b_Bit) u32_Crc ^= 0xEDB88320;
+            uint32_t u32_Low = u32_Crc ^ ((uint32_t)u8_Data[0]       | ((uint32_t)u8_Data[1] << 8) | 
+                                          ((uint32_t)u8_Data[2] << 16) | ((uint32_t)u8_Data[3] << 24));
+            u32_Crc = T[7][u32_Low & 0xFF] ^ T[6][(u32_Low >> 8) & 0xFF] ^ T[5][(u32_Low >> 16) & 0xFF] ^ T[4][u32_Low >> 24] ^
+                      T[3][u8_Data[4]]     ^ T[2][u8_Data[5]]            ^ T[1][u8_Data[6]]             ^ T[0][u8_Data[7]];
         }
-    }
+        for (int i=0; i<s32_Length; i++)
+        {
+            u32_Crc = (u32_Crc >> 8) ^ T[0][(u32_Crc ^ u8_Data[i]) & 0xFF];
+        }
+    #else
+        for (int i=0; i<s32_Length; i++)
+        {
+            u32_Crc ^= u8_Data[i];
+            u32_Crc = (u32_Crc >> 4) ^ pgm_read_dword(CRC32_NIBBLE + (u32_Crc & 0x0F));
+            u32_Crc = (u32_Crc >> 4) ^ pgm_read_dword(CRC32_NIBBLE + (u32_Crc & 0x0F));
+        }
+    #endif
     return u32_Crc;
 }
 
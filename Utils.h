@@ -9,9 +9,47 @@
 // ATTENTION: Only one of the following defines must be set to true!
 // NOTE: In Software SPI mode there is no external libraray required. Only 4 regular digital pins are used.
 // If you want to transfer the code to another processor the easiest way will be to use Software SPI mode.
+// NOTE: In Hardware SPI mode the PN532 is connected to the SPI pins of the board (SCK, MISO, MOSI)
+// which it shares with the Ethernet shield. Only the chip select pin (SPI_CS_PIN) is exclusive.
+// Each frame is sent in one SPI transaction which is much faster than the bit banging of Software SPI.
+// NOTE: In HSU mode (High Speed UART) the PN532 is connected to a serial port (see HsuClass).
+// The baudrate is raised to PN532_HSU_BAUD after the wake up.
+// NOTE: The host tests in extras/host may select the mode on the command line (e.g. -DUSE_HSU=true).
+#if !defined(USE_SOFTWARE_SPI) && !defined(USE_HARDWARE_SPI) && !defined(USE_HARDWARE_I2C) && !defined(USE_HSU)
 #define USE_SOFTWARE_SPI   true
 #define USE_HARDWARE_SPI   false
 #define USE_HARDWARE_I2C   false
+#define USE_HSU            false
+#endif
+// ********************************************************************************/
+
+// *********************************************************************************
+// The highest debug level that is compiled into the code (see PN532::SetDebugLevel()).
+// 0 = The compiler removes all debug output. No code, no strings, no RAM and no time is wasted.
+// 1 = high level debug, 2 = + all frames sent to and received from the PN532, 3 = + ACK frames
+#define DEBUG_LEVEL_MAX    0
+
+// When debug output is compiled in, it is written into a RAM ring buffer of this size.
+// SerialClass::Drain() sends it to the PC in the background without ever waiting for the serial port.
+// So the debug output does not change the timing of the communication with the PN532.
+// When the buffer is full the text is discarded and a warning is printed later.
+// 0 = print directly (the caller waits until the text has been sent, at 115200 baud approx 90 us per character)
+#define LOG_BUFFER_SIZE    256
+// ********************************************************************************/
+
+#define USE_LOG_BUFFER  (DEBUG_LEVEL_MAX > 0 && LOG_BUFFER_SIZE > 0)
+
+// *********************************************************************************
+// CalcCrc32() uses lookup tables that the compiler generates.
+// true  -> slice-by-8: 8 tables of 256 entries (8 kB) process 8 bytes per step (ARM, PC)
+// false -> a table of 16 entries (64 byte) in flash memory (PROGMEM) processes 4 bits per step (AVR)
+#ifndef USE_CRC_SLICE_BY_8
+    #if defined(__AVR__)
+        #define USE_CRC_SLICE_BY_8  false
+    #else
+        #define USE_CRC_SLICE_BY_8  true
+    #endif
+#endif
 // ********************************************************************************/
 
 #include <Arduino.h>
@@ -22,6 +60,8 @@
     #include <Wire.h> // Hardware I2C bus
 #elif USE_SOFTWARE_SPI
     // no #include required
+#elif USE_HSU
+    // no #include required
 #else
     #error "You must specify the PN532 communication mode."
 #endif
@@ -75,12 +115,21 @@ public:
     {
         return Serial.read();
     }
-    // Print text to the Terminal program on the PC
-  // On Windows/Linux use printf() here to write debug output an errors to the Console.
-    static inline void Print(const char* s8_Text)
-    {
-        Serial.print(s8_Text);
-    }
+    #if USE_LOG_BUFFER
+        // Print() only stores the text in the log buffer. Drain() must be called regularly from loop().
+        static void Print(const char* s8_Text);
+        static void Drain();
+    #else
+        // Print text to the Terminal program on the PC
+      // On Windows/Linux use printf() here to write debug output an errors to the Console.
+        static inline void Print(const char* s8_Text)
+        {
+            Serial.print(s8_Text);
+        }
+        static inline void Drain()
+        {
+        }
+    #endif
 };
 
 // -------------------------------------------------------------------------------------------------------------------
@@ -89,19 +138,35 @@ public:
     // This class implements Hardware SPI (4 wire bus). It is not used for the DoorOpener sketch.
     // When you compile the code for Linux, Windows or any other platform you must modify this class.
     // NOTE: This class is not used when you switched to I2C mode with PN532::InitI2C() or Software SPI mode with PN532::InitSoftwareSPI().
+    // The SPI bus may be shared with other devices (e.g. the Ethernet shield) which use other settings (MSBFIRST).
+    // Therefore each PN532 frame is transferred inside its own transaction (BeginTransaction() ... EndTransaction()).
     class SpiClass
     {  
     public:
-        static inline void Begin(uint32_t u32_Clock) 
+        static inline void Begin() 
         {
             SPI.begin();
+        }
+        // Locks the bus and applies the clock, bit order and mode of the PN532
+        static inline void BeginTransaction(uint32_t u32_Clock) 
+        {
             SPI.beginTransaction(SPISettings(u32_Clock, LSBFIRST, SPI_MODE0));
         }
+        static inline void EndTransaction() 
+        {
+            SPI.endTransaction();
+        }
         // Write one byte to the MOSI pin and at the same time receive one byte on the MISO pin.
         static inline byte Transfer(byte u8_Data) 
         {
             return SPI.transfer(u8_Data);
         }
+        // Transfer an entire buffer at once.
+        // ATTENTION: The bytes in u8_Buffer are sent and then overwritten with the bytes received on the MISO pin!
+        static inline void Transfer(byte* u8_Buffer, int s32_Length) 
+        {
+            SPI.transfer(u8_Buffer, s32_Length);
+        }
     };
 #endif
 
@@ -153,6 +218,46 @@ public:
 
 // -------------------------------------------------------------------------------------------------------------------
 
+#if USE_HSU
+    // This class implements the High Speed UART of the PN532 (interface select pins I0 = I1 = low). It is not used for the DoorOpener sketch.
+    // The PN532 starts with 115200 baud. PN532::SetSerialBaudRate() switches both sides to a higher baudrate.
+    // When you compile the code for Linux, Windows or any other platform you must modify this class.
+    // On Linux open the serial port (e.g. /dev/ttyUSB0 of an USB to serial adapter or the pseudo terminal of a PN532 simulator) 
+    // with open() and set the baudrate with cfsetspeed() / tcsetattr().
+    // NOTE: The board must have a second serial port. Serial is used for debug output.
+    #define PN532_HSU_PORT  Serial1
+
+    class HsuClass
+    {  
+    public:
+        static inline void Begin(uint32_t u32_Baud) 
+        {
+            PN532_HSU_PORT.begin(u32_Baud);
+        }
+        // returns how many received bytes are waiting in the buffer
+        static inline int Available()
+        {
+            return PN532_HSU_PORT.available();
+        }
+        // returns the next received byte or -1 if no byte is available
+        static inline int Read()
+        {
+            return PN532_HSU_PORT.read();
+        }
+        static inline void Write(const byte* u8_Data, int s32_Length)
+        {
+            PN532_HSU_PORT.write(u8_Data, s32_Length);
+        }
+        // Waits until all bytes have been sent
+        static inline void Flush()
+        {
+            PN532_HSU_PORT.flush();
+        }
+    };
+#endif
+
+// -------------------------------------------------------------------------------------------------------------------
+
 class Utils
 {
 public:
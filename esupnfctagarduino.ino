@@ -1,4 +1,7 @@
 #include "Desfire.h"
+#include "ApduScript.h"
+#include "ProgramCache.h"
+#include "CardCache.h"
 #include "Buffer.h"
 #include <LiquidCrystal_I2C.h>
 #include <SPI.h>
@@ -27,18 +30,153 @@ char* server = "esup-nfc-tag.univ-ville.fr";
 // The software SPI MOSI pin (Master Out, Slave In)
 #define SPI_MOSI_PIN      3
 // The software SPI SSEL pin (Chip Select)
+// In Hardware SPI mode (USE_HARDWARE_SPI in Utils.h) only this pin is used,
+// the clock and data lines are the hardware SPI pins shared with the Ethernet shield.
 #define SPI_CS_PIN        4
+// The pin connected to P70_IRQ of the PN532 (optional)
+// The PN532 pulls it low when a response is ready, so there is no need to poll the status byte.
+// Set PN532_NO_IRQ if it is not connected (polling mode). Any free digital pin can be used (e.g. A0).
+#define SPI_IRQ_PIN       PN532_NO_IRQ
 // If using the breakout or shield with I2C, define just the pins connected
 // to the IRQ and reset lines.  Use the values below (2, 3) for the shield!
 #define PN532_IRQ   (2)
 #define PN532_RESET (3)  // Not connected by default on the NFC Shield
 
-#define RF_OFF_INTERVAL  1000
+// The interval in milliseconds between two polls for a card.
+// Between the polls the RF field is off (see USE_POWERDOWN).
+#define RF_OFF_INTERVAL  100
+
+// true  -> The PN532 sleeps in PowerDown mode between the polls and is woken up for each poll.
+//          The board consumes only a few mA and the RF field is on only during the short poll.
+// false -> Only the RF field is switched off between the polls (the board consumes approx 18 mA)
+#define USE_POWERDOWN    true
+
+// The retries of one poll (see SetPassiveActivationRetries()). 
+// As the polls are frequent a card that has been missed is detected in the next poll.
+// More retries keep the RF field on longer when no card is present.
+#define POLL_RETRIES     1
+
+// true  -> The PN532 searches for cards on its own (InAutoPoll) and the loop only checks if it has found one.
+//          There is no command traffic while no card is present. USE_POWERDOWN and RF_OFF_INTERVAL are not used.
+// false -> The loop polls for a card every RF_OFF_INTERVAL milliseconds
+#define USE_AUTOPOLL     false
+
+// The time between two polling cycles of the PN532 in auto poll mode in units of 150 ms (1...15)
+#define AUTOPOLL_PERIOD  1
+
+// true  -> After a successful transaction with a Desfire card the RF field stays on and the card stays selected.
+//          Every RF_OFF_INTERVAL a presence check tests if the card is still there.
+//          The card is processed only once while it stays on the reader.
+//          ATTENTION: The RF field (approx 110 mA) stays on up to SESSION_IDLE_TIMEOUT while the card is on the reader.
+// false -> The RF field is switched off after each transaction and a card that stays on the reader is processed again.
+#define USE_PRESENCE_CHECK   false
+
+// The time in milliseconds after which the RF field is switched off although the card is still present.
+// Then the card is activated again and processed like a new card.
+#define SESSION_IDLE_TIMEOUT 10000
+
+// true  -> When the card responds 0xAF (more frames) the additional frames are read immediately
+//          and all the data is sent to the server in one request with the final status (normally 9100).
+//          The server must request the total size of all frames.
+// false -> The server receives each frame with the status 91AF and requests the next frame itself.
+#define USE_FRAME_CHAINING   false
+
+// USE_DESFIRE (authentication of Desfire cards in random ID mode) is defined in Desfire.h.
+
+// The PICC master key of the cards with random ID (only used with USE_DESFIRE).
+// true  -> AES key (16 byte)
+// false -> DES (8 byte), 2K3DES (16 byte) or 3K3DES (24 byte) key
+// The factory default is a simple DES key of 8 zeroes.
+#define PICC_KEY_AES         false
+#define PICC_KEY_SIZE        8
+const byte PICC_MASTER_KEY[PICC_KEY_SIZE] = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
+
+// true  -> The server may send a script of several APDUs in one response (code "BATCH", the script in "param").
+//          The APDUs are executed back to back and the results of all steps are sent with the next request
+//          separated by commas. Each request tells the server the maximum script size (parameter "batch").
+// false -> The server sends one APDU per response.
+// RAM: approx 384 byte static (ApduScript) + 384 byte on the stack with the default SCRIPT_MAX_SIZE (see ApduScript.h).
+// ATTENTION: A board with 2 kB SRAM (ATmega328) has not enough RAM for this. Reduce SCRIPT_MAX_SIZE and SCRIPT_RESULT_SIZE.
+#define USE_APDU_SCRIPT      false
+
+// true  -> The server may send a program (code "PROGRAM", a script like "BATCH") that is executed on every card.
+//          The program is kept in a cache (see ProgramCache.h, optionally in the EEPROM) and identified by its hash.
+//          A new card runs the program immediately and the first request sends its results and the hash (parameter "program").
+//          The server continues with these results or answers "INVALID" to discard the program.
+// false -> Each transaction starts with an empty request.
+// RAM: PROGRAM_CACHE_SLOTS * (SCRIPT_MAX_SIZE + 7) byte static, 270 byte with the defaults (see ProgramCache.h).
+#define USE_PROGRAM_CACHE    false
+
+// true  -> Static responses of the cards (GetVersion, application IDs, file settings,...) are kept per UID (see CardCache.h).
+//          When the same card is presented again these commands are answered without RF communication.
+//          The hit counters are printed after each transaction.
+// false -> All commands are sent to the card.
+// RAM: CARD_CACHE_CARDS * (CARD_CACHE_BYTES + 17) byte static on AVR, 580 byte with the defaults (see CardCache.h).
+#define USE_CARD_CACHE       false
+
+// true  -> A new Desfire card runs the opening APDUs of OPENING_SCRIPT at once (a script like "BATCH", see ApduScript.h)
+//          and the first request sends their results and the CRC32 of the script (parameter "opening").
+//          The server continues with these results or answers "INVALID" to start without them.
+//          An active program of the server (USE_PROGRAM_CACHE) replaces the opening APDUs.
+// false -> Each transaction starts with an empty request.
+// RAM: only the string OPENING_SCRIPT, but USE_APDU_SCRIPT is required (see there).
+#define USE_OPENING_SCRIPT   false
+
+// The opening APDUs as hex string. Each step is: [Flags] [Expected status] [Receive size] [Length N] [Command] [N-1 parameter bytes]
+// Default: GetVersion with all frames
+//     05       Flags: SCRIPT_CHAINED | SCRIPT_CONTINUE
+//     00       Expected status: Success
+//     1C       Receive size: 28 bytes
+//     01       Length: the command only
+//     60       GetVersion
+// To select the application of the campus append a second step:
+//     00       Flags: none
+//     00       Expected status: Success
+//     00       Receive size: no data
+//     04       Length: command + 3 bytes AID
+//     5A       SelectApplication
+//     563412   AID 0x123456 with the least significant byte first
+// -> "05001C0160" "000000045A563412"
+#define OPENING_SCRIPT       "05001C0160"
+
+#if (USE_PROGRAM_CACHE || USE_OPENING_SCRIPT) && !USE_APDU_SCRIPT
+    #error "USE_PROGRAM_CACHE and USE_OPENING_SCRIPT require USE_APDU_SCRIPT"
+#endif
+
+// true -> Tests DES, 3DES, AES and CMAC with known test vectors at startup (the result is visible only with debug output)
+#define USE_CRYPTO_SELFTEST  false
+
+#if USE_CRYPTO_SELFTEST && !USE_DESFIRE
+    #error "USE_CRYPTO_SELFTEST requires USE_DESFIRE in Desfire.h"
+#endif
 
 
 Desfire gi_PN532;
+#if USE_APDU_SCRIPT
+    ApduScript gi_Script;
+#endif
+#if USE_PROGRAM_CACHE
+    ProgramCache gi_Programs;
+#endif
+#if USE_OPENING_SCRIPT
+    bool gb_OpeningValid = true; // false after the server has answered "INVALID"
+#endif
+#if USE_CARD_CACHE
+    CardCache gi_CardCache;
+    #define CARD_CACHE_PTR  &gi_CardCache
+#else
+    #define CARD_CACHE_PTR  NULL
+#endif
+#if USE_DESFIRE && PICC_KEY_AES
+    AES gi_PiccMasterKey;
+#elif USE_DESFIRE
+    DES gi_PiccMasterKey;
+#endif
 uint64_t   gu64_LastID     = 0;  
 bool       gb_InitSuccess  = false; // true if the PN532 has been initialized successfully
+bool       gb_PowerDown    = false; // true if the PN532 is in PowerDown mode
+bool       gb_CardSession  = false; // true if the RF field is on and the last card is still selected (USE_PRESENCE_CHECK)
+uint64_t   gu64_SessionTick = 0;    // the time when the last transaction of the session has finished
 int   mu8_LastPN532Error   = 0;    
 
 // Initialize the Ethernet client library
@@ -129,8 +267,26 @@ void setup() {
       delay(2000);
   }
   
-  gi_PN532.InitSoftwareSPI(SPI_CLK_PIN, SPI_MISO_PIN, SPI_MOSI_PIN, SPI_CS_PIN, RESET_PIN);
+  #if USE_HARDWARE_SPI
+    gi_PN532.InitHardwareSPI(SPI_CS_PIN, RESET_PIN);
+  #elif USE_HARDWARE_I2C
+    gi_PN532.InitI2C(RESET_PIN);
+  #elif USE_HSU
+    gi_PN532.InitHSU(RESET_PIN);
+  #else
+    gi_PN532.InitSoftwareSPI(SPI_CLK_PIN, SPI_MISO_PIN, SPI_MOSI_PIN, SPI_CS_PIN, RESET_PIN);
+  #endif
+  gi_PN532.SetIrqPin(SPI_IRQ_PIN);
   gi_PN532.SetDebugLevel(0);
+  #if USE_DESFIRE
+      gi_PiccMasterKey.SetKeyData(PICC_MASTER_KEY, PICC_KEY_SIZE, 0);
+  #endif
+  #if USE_CRYPTO_SELFTEST
+      gi_PN532.Selftest();
+  #endif
+  #if USE_PROGRAM_CACHE
+      gi_Programs.Begin();
+  #endif
   InitReader(false);
   lcd.noBacklight();
   digitalWrite(LED_VERTE, HIGH);
@@ -139,39 +295,128 @@ void setup() {
  
 void loop() {
 
+  // Send the buffered debug output to the PC (does nothing when DEBUG_LEVEL_MAX = 0)
+  SerialClass::Drain();
+
   uint64_t u64_StartTick = Utils::GetMillis64();
   static uint64_t u64_LastRead = 0;
     if (gb_InitSuccess)
       {
-          // Turn on the RF field for 100 ms then turn it off for one second (RF_OFF_INTERVAL) to safe battery
-          if ((int)(u64_StartTick - u64_LastRead) < RF_OFF_INTERVAL)
+          // Turn on the RF field for a short poll then turn it off for RF_OFF_INTERVAL to safe battery
+          if (!USE_AUTOPOLL && (int)(u64_StartTick - u64_LastRead) < RF_OFF_INTERVAL)
               return;
       }else{
         
         InitReader(true); // flash red LED for 2.4 seconds
         
     }
-    uint8_t uid[] = { 0, 0, 0, 0, 0, 0, 0 };  // Buffer to store the returned UID
+
+    #if USE_PRESENCE_CHECK
+        // The card of the last transaction is still selected
+        if (gb_CardSession)
+        {
+            u64_LastRead = Utils::GetMillis64();
+            if ((int)(u64_StartTick - gu64_SessionTick) < SESSION_IDLE_TIMEOUT && gi_PN532.CheckPresence())
+                return;
+
+            // The card has been removed or the session timed out
+            gb_CardSession = false;
+            SwitchOffReader();
+            return;
+        }
+    #endif
+
+    if (gb_PowerDown)
+    {
+        gi_PN532.WakeUp();
+        gb_PowerDown = false;
+    }
+
+    uint8_t uid[] = { 0, 0, 0, 0, 0, 0, 0, 0 };  // Buffer to store the returned UID (ReadCard() requires 8 bytes)
     kCard k_Card;
     if (!ReadCard(uid, &k_Card))
     {
-        if (k_Card.b_PN532_Error) InitReader(true);            
+        // Try the cheap recovery steps first. The reset in InitReader() takes more than 420 ms.
+        if (k_Card.b_PN532_Error && !gi_PN532.Recover()) InitReader(true);            
         
     }
+    else gi_PN532.ResetRecovery(); // the PN532 works again
+
+    #if USE_AUTOPOLL
+        // The PN532 is still searching for a card
+        if (k_Card.u8_UidLength == 0 && gi_PN532.IsAutoPoll())
+            return;
+    #endif
+
+    bool b_CardProcessed  = k_Card.u8_UidLength != 0;
+    bool b_TransactionOk  = false;
     // No card present in the RF field
     if (k_Card.u8_UidLength == 0) 
     {
         gu64_LastID = 0;
     }else{
 
+      #if USE_CARD_CACHE
+          // A card in random ID mode is still authenticated from reading the real UID
+          gi_CardCache.SelectCard(uid, k_Card.u8_UidLength, k_Card.e_CardType == CARD_DesRandom);
+      #endif
+
       String result = "";
       String jSessionId = "";
+      #if USE_PROGRAM_CACHE
+          // A new card runs the active program at once. The first request sends only its results.
+          uint32_t u32_Program = gi_Programs.GetActive();
+          if (u32_Program != 0)
+          {
+              DESFireStatus e_Status;
+              if (gi_Programs.LoadScript(u32_Program, &gi_Script))
+                  executeScript(&e_Status, &result);
+              else
+                  u32_Program = 0;
+          }
+      #endif
+      #if USE_OPENING_SCRIPT
+          // The opening APDUs are executed before the connection to the server, the first request sends their results.
+          uint32_t u32_Opening = 0;
+          bool b_Opening = gb_OpeningValid && k_Card.e_CardType != CARD_Unknown;
+          #if USE_PROGRAM_CACHE
+              b_Opening = b_Opening && u32_Program == 0;
+          #endif
+          if (b_Opening)
+          {
+              DESFireStatus e_Status;
+              if (runScript(OPENING_SCRIPT, sizeof(OPENING_SCRIPT) - 1, &e_Status, &result) >= 0 || result.length() > 0)
+                  u32_Opening = Utils::CalcCrc32(gi_Script.GetScript(), gi_Script.GetScriptLength());
+          }
+      #endif
       while(true){
        if(client.connect(server, 80)){
         client.print("GET /desfire-ws/?result=");
         client.print(result);
         client.print("&numeroId=");
         client.print(ARDUINO_ID);
+        #if USE_APDU_SCRIPT
+            client.print("&batch=");
+            client.print(SCRIPT_MAX_SIZE);
+        #endif
+        #if USE_PROGRAM_CACHE
+            if (u32_Program != 0)
+            {
+                char s8_Hash[9];
+                sprintf(s8_Hash, "%08lX", (unsigned long)u32_Program);
+                client.print("&program=");
+                client.print(s8_Hash);
+            }
+        #endif
+        #if USE_OPENING_SCRIPT
+            if (u32_Opening != 0)
+            {
+                char s8_Hash[9];
+                sprintf(s8_Hash, "%08lX", (unsigned long)u32_Opening);
+                client.print("&opening=");
+                client.print(s8_Hash);
+            }
+        #endif
         client.println(" HTTP/1.1");  
         client.print("Host: ");
         client.println(server);
@@ -185,7 +430,11 @@ void loop() {
         boolean startRead = 0; 
         int currentParam = 0;
         char cmd[2];
-        char param[64];
+        #if USE_APDU_SCRIPT
+            char param[2 * SCRIPT_MAX_SIZE];
+        #else
+            char param[64];
+        #endif
         String code = "";
         String sizeReturn = "";
         jSessionId = "";
@@ -213,8 +462,10 @@ void loop() {
                           cmdSize++;
                         } else 
                         if(currentParam==11) {
-                          param[paramSize] = c;
-                          paramSize++;
+                          if(paramSize < (int)sizeof(param)) {
+                            param[paramSize] = c;
+                            paramSize++;
+                          }
                         } else 
                         if(currentParam==15) {
                           sizeReturn += c;
@@ -236,27 +487,61 @@ void loop() {
         }
           client.stop();   
           client.flush();
-           int nbByteReturn = sizeReturn.toInt();
-      
-           byte u8_RecvBuf[nbByteReturn];
-                      DESFireStatus e_Status;
 
-           int returnStatus = sendApdu(cmd, cmdSize, param, paramSize, &e_Status, u8_RecvBuf, nbByteReturn);
+          #if USE_PROGRAM_CACHE
+            if (u32_Program != 0)
+            {
+                // The server does not accept the program -> start the transaction again without the program
+                if (code == "INVALID")
+                {
+                    gi_Programs.Remove(u32_Program);
+                    u32_Program = 0;
+                    continue;
+                }
+                u32_Program = 0; // confirmed, the hash is sent only with the first request
+            }
+          #endif
+          #if USE_OPENING_SCRIPT
+            if (u32_Opening != 0)
+            {
+                u32_Opening = 0; // the results are sent only with the first request
+                // The server does not know the opening APDUs -> start the transaction again without them
+                if (code == "INVALID")
+                {
+                    gb_OpeningValid = false;
+                    result = "";
+                    continue;
+                }
+            }
+          #endif
 
- 
-           String resultData;
-           for (uint32_t i=0; i < sizeof(u8_RecvBuf); i++){
-                char s8_RecvBuf[2];
-                sprintf(s8_RecvBuf, "%02X", u8_RecvBuf[i]);
-                resultData+=s8_RecvBuf;
+           int nbByteReturn = sizeReturn.toInt();
+           DESFireStatus e_Status = ST_Success;
+           int returnStatus;
+
+           #if USE_APDU_SCRIPT
+           if(code=="BATCH" || code=="PROGRAM"){
+             returnStatus = runScript(param, paramSize, &e_Status, &result);
+             #if USE_PROGRAM_CACHE
+               // The program is executed on the following cards before the first request
+               if(code=="PROGRAM" && gi_Script.GetStepCount() > 0)
+                 gi_Programs.Store(gi_Script.GetScript(), gi_Script.GetScriptLength());
+             #endif
+           }else
+           #endif
+           {
+             byte u8_RecvBuf[nbByteReturn];
+             returnStatus = sendApdu(cmd, cmdSize, param, paramSize, &e_Status, u8_RecvBuf, nbByteReturn);
+             result = formatResult(u8_RecvBuf, sizeof(u8_RecvBuf), e_Status);
            }
-           char resultStatus[2];
+
+           char resultStatus[3];
            sprintf(resultStatus, "%02X", e_Status);
-           result = resultData+"91"+resultStatus; 
            Serial.println(result);
            lcd.backlight();
            lcd.clear();
-           if((((String) resultStatus == "00" || (String) resultStatus == "AF") && returnStatus>-1) || code=="END"){
+           // A script has checked the status of each step itself
+           if((((String) resultStatus == "00" || (String) resultStatus == "AF" || code=="BATCH" || code=="PROGRAM") && returnStatus>-1) || code=="END"){
             if(code=="END"){
 
               signalSuccess();
@@ -270,6 +555,7 @@ void loop() {
               lcd.print(location);
               lcd.noBacklight();
               k_Card.u8_UidLength=0;
+              b_TransactionOk = true;
               break;
             }else{
               signalProcess();
@@ -292,34 +578,79 @@ void loop() {
            }
          }
       }
+
+      #if USE_CARD_CACHE && DEBUG_LEVEL_MAX > 0
+          if (gi_PN532.mu8_DebugLevel > 0)
+          {
+              Utils::Print("Card cache hits: ");
+              Utils::PrintDec(gi_CardCache.GetHits(), " / ");
+              Utils::PrintDec(gi_CardCache.GetLookups(), LF);
+          }
+      #endif
     }
 
-    // Turn off the RF field to save battery
-    // When the RF field is on,  the PN532 board consumes approx 110 mA.
-    // When the RF field is off, the PN532 board consumes approx 18 mA.
-    gi_PN532.SwitchOffRfField();
+    #if USE_PRESENCE_CHECK
+        // Keep the Desfire card selected while it stays on the reader. After an error the card is activated again.
+        if (b_TransactionOk && k_Card.e_CardType != CARD_Unknown)
+        {
+            gb_CardSession   = true;
+            gu64_SessionTick = Utils::GetMillis64();
+        }
+    #endif
+
+    if (!gb_CardSession)
+        SwitchOffReader();
     u64_LastRead = Utils::GetMillis64();
-    delay(1000);
+
+    // Give the user the time to remove the card before it is read again
+    if (b_CardProcessed && !gb_CardSession)
+        delay(1000);
     digitalWrite(LED_VERTE, LOW);
     digitalWrite(LED_ROUGE, LOW);
   
 }
 
+// Turn off the RF field to save battery
+// When the RF field is on,  the PN532 board consumes approx 110 mA.
+// When the RF field is off, the PN532 board consumes approx 18 mA.
+// In PowerDown mode the RF field is off too and the PN532 itself consumes only a few uA.
+void SwitchOffReader()
+{
+    #if USE_POWERDOWN && !USE_AUTOPOLL
+        gb_PowerDown = gi_PN532.PowerDown();
+    #else
+        gi_PN532.SwitchOffRfField();
+    #endif
+}
+
 void InitReader(bool b_ShowError)
 {
 
     do // pseudo loop (just used for aborting with break;)
     {
         gb_InitSuccess = false;
+        gb_PowerDown   = false; // the reset wakes up the PN532
+        gb_CardSession = false; // the reset switches off the RF field
       
         // Reset the PN532
         gi_PN532.begin(); // delay > 400 ms
+        #if USE_HSU
+            // Switch from 115200 baud to PN532_HSU_BAUD
+            if (!gi_PN532.SetSerialBaudRate(PN532_HSU_BAUD))
+                break;
+        #endif
+
         byte IC, VersionHi, VersionLo, Flags;
         if (!gi_PN532.GetFirmwareVersion(&IC, &VersionHi, &VersionLo, &Flags))
             break;
+
+        // Use the fastest clock that the connection to the PN532 allows
+        if (!gi_PN532.CalibrateClock())
+            break;
+
         // Set the max number of retry attempts to read from a card.
         // This prevents us from waiting forever for a card, which is the default behaviour of the PN532.
-        if (!gi_PN532.SetPassiveActivationRetries())
+        if (!gi_PN532.SetPassiveActivationRetries(POLL_RETRIES))
             break;
         
         // configure the PN532 to read RFID tags
@@ -335,12 +666,39 @@ bool ReadCard(byte u8_UID[8], kCard* pk_Card)
 {
     memset(pk_Card, 0, sizeof(kCard));
   
-    if (!gi_PN532.ReadPassiveTargetID(u8_UID, &pk_Card->u8_UidLength, &pk_Card->e_CardType))
+    #if USE_AUTOPOLL
+        // Start the search again after the last card has been processed
+        bool b_Success = gi_PN532.IsAutoPoll() || gi_PN532.StartAutoPoll(AUTOPOLL_PERIOD);
+        if (b_Success)
+            b_Success = gi_PN532.CheckAutoPoll(u8_UID, &pk_Card->u8_UidLength, &pk_Card->e_CardType);
+    #else
+        // Read up to 2 cards at once. When a wallet with two cards is presented the Desfire card is used.
+        kTarget k_Targets[2];
+        byte u8_Count;
+        bool b_Success = gi_PN532.ReadPassiveTargets(k_Targets, 2, &u8_Count);
+        if (b_Success && u8_Count > 0)
+        {
+            kTarget* pk_Target = &k_Targets[0];
+            if (u8_Count == 2 && (pk_Target->e_CardType == CARD_Unknown || pk_Target->u8_UidLength == 0) && k_Targets[1].u8_UidLength > 0)
+                pk_Target = &k_Targets[1];
+
+            gi_PN532.SetTarget(pk_Target->u8_Tg);
+            memcpy(u8_UID, pk_Target->u8_Uid, pk_Target->u8_UidLength);
+            pk_Card->u8_UidLength = pk_Target->u8_UidLength;
+            pk_Card->e_CardType   = pk_Target->e_CardType;
+        }
+    #endif
+
+    if (!b_Success)
     {
         pk_Card->b_PN532_Error = true;
         return false;
     }
 
+    // Desfire cards can communicate faster than 106 kbps. If this fails, the card still works with 106 kbps.
+    if (pk_Card->u8_UidLength > 0 && pk_Card->e_CardType != CARD_Unknown)
+        gi_PN532.NegotiateBitRate();
+
     if (pk_Card->e_CardType == CARD_DesRandom) // The card is a Desfire card in random ID mode
     {
         #if USE_DESFIRE
@@ -373,6 +731,20 @@ uint8_t* convertCharStarHexToInt(char* str, int strSize){
   return strInt;
 }
 
+#if USE_DESFIRE
+// Authenticates with the PICC master key of a Desfire card
+bool AuthenticatePICC(byte* pu8_KeyVersion)
+{
+    if (!gi_PN532.SelectApplication(0x000000)) // PICC level
+        return false;
+
+    if (!gi_PN532.GetKeyVersion(0, pu8_KeyVersion)) // Get version of PICC master key
+        return false;
+
+    return gi_PN532.Authenticate(0, &gi_PiccMasterKey);
+}
+#endif
+
 int sendApdu(char* cmdStr, int cmdSize, char* paramStr, int paramSize, DESFireStatus* e_Status, byte* u8_RecvBuf, int s32_RecvSize){
         uint8_t* cmdInt = convertCharStarHexToInt(cmdStr, cmdSize);
         TX_BUFFER(i_cmd, 1);
@@ -385,10 +757,56 @@ int sendApdu(char* cmdStr, int cmdSize, char* paramStr, int paramSize, DESFireSt
             i_Params.AppendUint8(paramInt[i]);  
         }        
         free(paramInt);
-        int s32_Read = gi_PN532.DataExchange(&i_cmd, &i_Params, u8_RecvBuf, s32_RecvSize, e_Status, MAC_None);
+        #if USE_CARD_CACHE
+            int s32_Read = gi_CardCache.Exchange(&gi_PN532, &i_cmd, &i_Params, u8_RecvBuf, s32_RecvSize, e_Status, USE_FRAME_CHAINING);
+        #elif USE_FRAME_CHAINING
+            int s32_Read = gi_PN532.DataExchangeChained(&i_cmd, &i_Params, u8_RecvBuf, s32_RecvSize, e_Status, MAC_None);
+        #else
+            int s32_Read = gi_PN532.DataExchange(&i_cmd, &i_Params, u8_RecvBuf, s32_RecvSize, e_Status, MAC_None);
+        #endif
         return s32_Read;
 }
 
+// Formats the response of the card for the server: data + "91" + status (hex)
+String formatResult(const byte* u8_Data, int s32_Length, DESFireStatus e_Status){
+  String result;
+  char s8_Hex[3];
+  for (int i=0; i < s32_Length; i++){
+    sprintf(s8_Hex, "%02X", u8_Data[i]);
+    result += s8_Hex;
+  }
+  sprintf(s8_Hex, "%02X", e_Status);
+  return result + "91" + s8_Hex;
+}
+
+#if USE_APDU_SCRIPT
+// Executes a script of APDUs and formats the results of all executed steps separated by commas.
+// e_Status receives the status of the last executed step.
+// returns -1 if the script is invalid or a step has failed
+int runScript(const char* scriptStr, int scriptSize, DESFireStatus* e_Status, String* result){
+  *result = "";
+  if (!gi_Script.LoadHex(scriptStr, scriptSize))
+    return -1;
+  return executeScript(e_Status, result);
+}
+
+// Executes the script that is loaded in gi_Script (see runScript())
+int executeScript(DESFireStatus* e_Status, String* result){
+  *result = "";
+  if (gi_Script.Execute(&gi_PN532, CARD_CACHE_PTR) <= 0)
+    return -1;
+
+  for (byte S=0; S < gi_Script.GetExecutedSteps(); S++){
+    const byte* u8_Data;
+    int s32_Length;
+    gi_Script.GetStepResult(S, e_Status, &u8_Data, &s32_Length);
+    if (S > 0) *result += ",";
+    *result += formatResult(u8_Data, s32_Length, *e_Status);
+  }
+  return gi_Script.IsAborted() ? -1 : 0;
+}
+#endif
+
 void myTone(byte pin, uint16_t frequency, uint16_t duration)
 { // input parameters: Arduino pin number, frequency in Hz, duration in milliseconds
   unsigned long startTime=millis();
@@ -0,0 +1,71 @@
+/**************************************************************************
+
+    Minimal replacement of the Arduino core for the host tests (see Arduino.h)
+
+**************************************************************************/
+
+#include "Arduino.h"
+#include <time.h>
+
+HardwareSerial Serial;
+
+static uint64_t GetMicros64()
+{
+    timespec k_Time;
+    clock_gettime(CLOCK_MONOTONIC, &k_Time);
+    return (uint64_t)k_Time.tv_sec * 1000000 + k_Time.tv_nsec / 1000;
+}
+
+uint32_t millis()
+{
+    return (uint32_t)(GetMicros64() / 1000);
+}
+
+uint32_t micros()
+{
+    return (uint32_t)GetMicros64();
+}
+
+// The tests do not talk to a PN532, so there is nothing to wait for
+void delay(uint32_t) {}
+void delayMicroseconds(uint32_t) {}
+void pinMode(uint8_t, uint8_t) {}
+void digitalWrite(uint8_t, uint8_t) {}
+
+int digitalRead(uint8_t)
+{
+    return HIGH;
+}
+
+void HardwareSerial::begin(uint32_t) {}
+
+int HardwareSerial::available()
+{
+    return 0;
+}
+
+int HardwareSerial::availableForWrite()
+{
+    return 64;
+}
+
+int HardwareSerial::read()
+{
+    return -1;
+}
+
+size_t HardwareSerial::write(uint8_t u8_Char)
+{
+    putchar(u8_Char);
+    return 1;
+}
+
+void HardwareSerial::print(const char* s8_Text)
+{
+    fputs(s8_Text, stdout);
+}
+
+void HardwareSerial::println(const char* s8_Text)
+{
+    puts(s8_Text);
+}
@@ -0,0 +1,72 @@
+/**************************************************************************
+
+    Minimal replacement of the Arduino core for the host tests in this folder.
+    It provides only what the library files (Utils, PN532, Desfire, ...) use in Software SPI mode and HSU mode.
+    The pins do nothing, Serial writes to stdout and the time comes from the PC clock.
+    In HSU mode Serial1 is a serial device or pseudo terminal of Linux (see TermiosSerial.cpp).
+
+**************************************************************************/
+
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef uint8_t byte;
+typedef bool    boolean;
+
+#define OUTPUT   0x1
+#define INPUT    0x0
+#define HIGH     0x1
+#define LOW      0x0
+
+#define PROGMEM
+#define pgm_read_byte(p)   (*(const uint8_t*) (p))
+#define pgm_read_word(p)   (*(const uint16_t*)(p))
+#define pgm_read_dword(p)  (*(const uint32_t*)(p))
+
+uint32_t millis();
+uint32_t micros();
+void     delay(uint32_t u32_MilliSeconds);
+void     delayMicroseconds(uint32_t u32_MicroSeconds);
+void     pinMode(uint8_t u8_Pin, uint8_t u8_Mode);
+void     digitalWrite(uint8_t u8_Pin, uint8_t u8_Status);
+int      digitalRead(uint8_t u8_Pin);
+
+class HardwareSerial
+{
+public:
+    void   begin(uint32_t u32_Baud);
+    int    available();
+    int    availableForWrite();
+    int    read();
+    size_t write(uint8_t u8_Char);
+    void   print(const char* s8_Text);
+    void   println(const char* s8_Text);
+};
+
+extern HardwareSerial Serial;
+
+// The serial port of the PN532 in HSU mode (PN532_HSU_PORT in Utils.h)
+class TermiosSerial
+{
+public:
+    TermiosSerial();
+    bool   Open(const char* s8_Device);
+    void   begin(uint32_t u32_Baud);
+    int    available();
+    int    read();
+    size_t write(const uint8_t* u8_Data, size_t u32_Length);
+    void   flush();
+
+private:
+    int ms32_Handle;
+};
+
+extern TermiosSerial Serial1;
+
+#endif // HOST_ARDUINO_H
@@ -0,0 +1,118 @@
+/**************************************************************************
+
+    Host test for Utils::CalcCrc32(): compares the table CRC with the bitwise CRC32
+    of the original code for known vectors and random data of random length and alignment
+    and measures the speed of both.
+    The table is selected at compile time (USE_CRC_SLICE_BY_8 in Utils.h), so build and run
+    the test once for each table on Linux from the root folder of the repository:
+
+    g++ -std=gnu++11 -O2 -DUSE_CRC_SLICE_BY_8=true  -Iextras/host -I. extras/host/CrcTest.cpp extras/host/Arduino.cpp \
+        Utils.cpp -o CrcTest && ./CrcTest
+    g++ -std=gnu++11 -O2 -DUSE_CRC_SLICE_BY_8=false -Iextras/host -I. extras/host/CrcTest.cpp extras/host/Arduino.cpp \
+        Utils.cpp -o CrcTest && ./CrcTest
+
+    returns 0 if all tests pass
+
+**************************************************************************/
+
+#include "Utils.h"
+
+static int s32_Failed = 0;
+
+// The bitwise CRC32 that CalcCrc32() used before the lookup tables
+static uint32_t CalcCrc32Bitwise(const byte* u8_Data, int s32_Length, uint32_t u32_Crc)
+{
+    for (int i=0; i<s32_Length; i++)
+    {
+        u32_Crc ^= u8_Data[i];
+        for (int b=0; b<8; b++)
+        {
+            bool b_Bit = (u32_Crc & 0x01) > 0;
+            u32_Crc >>= 1;
+            if (b_Bit) u32_Crc ^= 0xEDB88320;
+        }
+    }
+    return u32_Crc;
+}
+
+static void Check(const char* s8_Name, uint32_t u32_Result, uint32_t u32_Expected)
+{
+    bool b_OK = u32_Result == u32_Expected;
+    printf("%s %-28s 0x%08X\n", b_OK ? "PASS" : "FAIL", s8_Name, u32_Result);
+    if (!b_OK)
+        s32_Failed ++;
+}
+
+// Prints the throughput of CalcCrc32() and of the bitwise CRC
+static void Benchmark(const byte* u8_Data, int s32_Length)
+{
+    const int LOOPS = 200;
+
+    uint32_t u32_Crc   = 0;
+    uint32_t u32_Start = micros();
+    for (int i=0; i<LOOPS; i++)
+    {
+        u32_Crc ^= Utils::CalcCrc32(u8_Data, s32_Length);
+    }
+    uint32_t u32_Table = micros() - u32_Start;
+
+    u32_Start = micros();
+    for (int i=0; i<LOOPS; i++)
+    {
+        u32_Crc ^= CalcCrc32Bitwise(u8_Data, s32_Length, 0xFFFFFFFF);
+    }
+    uint32_t u32_Bitwise = micros() - u32_Start;
+
+    // LOOPS is even, so u32_Crc must be zero if both CRCs are equal
+    Check("Benchmark CRCs equal", u32_Crc, 0);
+
+    double d_Bytes = (double)LOOPS * s32_Length;
+    printf("%-8s %7.1f MB/s\n", "Table",   d_Bytes / (u32_Table   ? u32_Table   : 1));
+    printf("%-8s %7.1f MB/s\n", "Bitwise", d_Bytes / (u32_Bitwise ? u32_Bitwise : 1));
+}
+
+int main()
+{
+    printf("CRC table: %s\n", USE_CRC_SLICE_BY_8 ? "slice-by-8" : "nibble (PROGMEM)");
+
+    // The standard check value of CRC-32 for "123456789" is 0xCBF43926 (with final XOR)
+    static const byte CHECK[] = { '1', '2', '3', '4', '5', '6', '7', '8', '9' };
+    Check("Check value",     Utils::CalcCrc32(CHECK, sizeof(CHECK)),          ~0xCBF43926);
+    Check("Empty",           Utils::CalcCrc32(CHECK, 0),                       0xFFFFFFFF);
+    Check("Split 4 + 5",     Utils::CalcCrc32(CHECK, 4, CHECK + 4, 5),        ~0xCBF43926);
+
+    // 7 byte UID + status as GetRealCardID() calculates it
+    static const byte UID[] = { 0x04, 0x51, 0x2A, 0x72, 0xB3, 0x2B, 0x80 };
+    byte u8_Status = 0x00;
+    Check("UID + status",    Utils::CalcCrc32(UID, sizeof(UID), &u8_Status, 1),
+                             CalcCrc32Bitwise(&u8_Status, 1, CalcCrc32Bitwise(UID, sizeof(UID), 0xFFFFFFFF)));
+
+    // Random data with random length and alignment, split at a random position.
+    // The lengths cover the slice-by-8 loop and the remaining 0...7 bytes.
+    byte u8_Random[1024];
+    srand(1);
+    for (int i=0; i<(int)sizeof(u8_Random); i++)
+    {
+        u8_Random[i] = (byte)rand();
+    }
+
+    int s32_Mismatches = 0;
+    for (int t=0; t<10000; t++)
+    {
+        int s32_Offset = rand() % 8;
+        int s32_Length = rand() % (sizeof(u8_Random) - 8);
+        int s32_Split  = rand() % (s32_Length + 1);
+        const byte* u8_Data = u8_Random + s32_Offset;
+
+        uint32_t u32_Expected = CalcCrc32Bitwise(u8_Data, s32_Length, 0xFFFFFFFF);
+        if (Utils::CalcCrc32(u8_Data, s32_Length) != u32_Expected ||
+            Utils::CalcCrc32(u8_Data, s32_Split, u8_Data + s32_Split, s32_Length - s32_Split) != u32_Expected)
+            s32_Mismatches ++;
+    }
+    Check("Random data mismatches", s32_Mismatches, 0);
+
+    Benchmark(u8_Random, sizeof(u8_Random));
+
+    printf("%d test(s) failed\n", s32_Failed);
+    return s32_Failed ? 1 : 0;
+}
@@ -0,0 +1,113 @@
+/**************************************************************************
+
+    Host test for the Desfire ciphers: runs DESFireKey::Selftest(), additional
+    CBC / CMAC vectors with several blocks and measures the speed of each cipher.
+    Desfire EV1 uses the standard ciphers, so the vectors come from
+    FIPS 46-3, SP 800-67, FIPS 197, SP 800-38A, SP 800-38B and RFC 4493.
+    Build and run on Linux from the root folder of the repository:
+
+    g++ -std=gnu++11 -O2 -Iextras/host -I. extras/host/CryptoTest.cpp extras/host/Arduino.cpp \
+        DesFireKey.cpp AES128.cpp DES.cpp Utils.cpp -o CryptoTest && ./CryptoTest
+
+    returns 0 if all tests pass
+
+**************************************************************************/
+
+#include "AES128.h"
+#include "DES.h"
+
+static int s32_Failed = 0;
+
+static void Check(const char* s8_Name, const byte* u8_Result, const byte* u8_Expected, int s32_Length)
+{
+    bool b_OK = memcmp(u8_Result, u8_Expected, s32_Length) == 0;
+    printf("%s %s\n", b_OK ? "PASS" : "FAIL", s8_Name);
+    if (!b_OK)
+        s32_Failed ++;
+}
+
+// Prints the time per block and the throughput of CryptDataBlock()
+static void Benchmark(const char* s8_Name, DESFireKey* pi_Key)
+{
+    const uint32_t BLOCKS = 200000;
+    byte u8_Block[16] = {0};
+
+    uint32_t u32_Start = micros();
+    for (uint32_t i=0; i<BLOCKS; i++)
+    {
+        pi_Key->CryptDataBlock(u8_Block, u8_Block, KEY_ENCIPHER);
+    }
+    uint32_t u32_Micros = micros() - u32_Start;
+
+    printf("%-8s %7.3f us per block, %6.1f MB/s\n", s8_Name, (double)u32_Micros / BLOCKS,
+           (double)BLOCKS * pi_Key->GetBlockSize() / (u32_Micros ? u32_Micros : 1));
+}
+
+int main()
+{
+    // SP 800-38A F.1 / F.2: the 4 plaintext blocks, the AES key and the CBC-AES128 ciphertext with IV = 000102..0F
+    static const byte KEY_AES[16] = { 0x2B, 0x7E, 0x15, 0x16, 0x28, 0xAE, 0xD2, 0xA6, 0xAB, 0xF7, 0x15, 0x88, 0x09, 0xCF, 0x4F, 0x3C };
+    static const byte MSG[64] =
+    {
+        0x6B, 0xC1, 0xBE, 0xE2, 0x2E, 0x40, 0x9F, 0x96, 0xE9, 0x3D, 0x7E, 0x11, 0x73, 0x93, 0x17, 0x2A,
+        0xAE, 0x2D, 0x8A, 0x57, 0x1E, 0x03, 0xAC, 0x9C, 0x9E, 0xB7, 0x6F, 0xAC, 0x45, 0xAF, 0x8E, 0x51,
+        0x30, 0xC8, 0x1C, 0x46, 0xA3, 0x5C, 0xE4, 0x11, 0xE5, 0xFB, 0xC1, 0x19, 0x1A, 0x0A, 0x52, 0xEF,
+        0xF6, 0x9F, 0x24, 0x45, 0xDF, 0x4F, 0x9B, 0x17, 0xAD, 0x2B, 0x41, 0x7B, 0xE6, 0x6C, 0x37, 0x10,
+    };
+    static const byte CBC_CIPHER[64] =
+    {
+        0x76, 0x49, 0xAB, 0xAC, 0x81, 0x19, 0xB2, 0x46, 0xCE, 0xE9, 0x8E, 0x9B, 0x12, 0xE9, 0x19, 0x7D,
+        0x50, 0x86, 0xCB, 0x9B, 0x50, 0x72, 0x19, 0xEE, 0x95, 0xDB, 0x11, 0x3A, 0x91, 0x76, 0x78, 0xB2,
+        0x73, 0xBE, 0xD6, 0xB8, 0xE3, 0xC1, 0x74, 0x3B, 0x71, 0x16, 0xE6, 0x9E, 0x22, 0x22, 0x95, 0x16,
+        0x3F, 0xF1, 0xCA, 0xA1, 0x68, 0x1F, 0xAC, 0x09, 0x12, 0x0E, 0xCA, 0x30, 0x75, 0x86, 0xE1, 0xA7,
+    };
+    // RFC 4493: AES-CMAC of 40 and 64 byte
+    static const byte CMAC_AES_40[16] = { 0xDF, 0xA6, 0x67, 0x47, 0xDE, 0x9A, 0xE6, 0x30, 0x30, 0xCA, 0x32, 0x61, 0x14, 0x97, 0xC8, 0x27 };
+    static const byte CMAC_AES_64[16] = { 0x51, 0xF0, 0xBE, 0xBF, 0x7E, 0x3B, 0x9D, 0x92, 0xFC, 0x49, 0x74, 0x17, 0x79, 0x36, 0x3C, 0xFE };
+
+    bool b_Selftest = DESFireKey::Selftest(true);
+    printf("%s DESFireKey::Selftest()\n", b_Selftest ? "PASS" : "FAIL");
+    if (!b_Selftest)
+        s32_Failed ++;
+
+    AES  i_Aes;
+    byte u8_Out[64];
+    i_Aes.SetKeyData(KEY_AES, 16, 0);
+
+    // The IV 000102..0F is XORed into the first block, so the CBC can start with a zero IV.
+    byte u8_Plain[64];
+    memcpy(u8_Plain, MSG, sizeof(MSG));
+    for (byte i=0; i<16; i++)
+    {
+        u8_Plain[i] ^= i;
+    }
+    i_Aes.ClearIV();
+    i_Aes.CryptDataCBC(KEY_ENCIPHER, u8_Out, u8_Plain, 64);
+    Check("AES CBC encrypt 64", u8_Out, CBC_CIPHER, 64);
+
+    i_Aes.ClearIV();
+    i_Aes.CryptDataCBC(KEY_DECIPHER, u8_Out, CBC_CIPHER, 64);
+    Check("AES CBC decrypt 64", u8_Out, u8_Plain, 64);
+
+    i_Aes.ClearIV();
+    i_Aes.CalculateCmac(MSG, 40, u8_Out);
+    Check("AES CMAC 40", u8_Out, CMAC_AES_40, 16);
+
+    i_Aes.ClearIV();
+    i_Aes.CalculateCmac(MSG, 64, u8_Out);
+    Check("AES CMAC 64", u8_Out, CMAC_AES_64, 16);
+
+    static const byte KEY_DES[24] = { 0x01, 0x23, 0x45, 0x67, 0x89, 0xAB, 0xCD, 0xEF, 0x23, 0x45, 0x67, 0x89, 0xAB, 0xCD, 0xEF, 0x01, 0x45, 0x67, 0x89, 0xAB, 0xCD, 0xEF, 0x01, 0x23 };
+    DES i_Des, i_2K3Des, i_3K3Des;
+    i_Des   .SetKeyData(KEY_DES,  8, 0);
+    i_2K3Des.SetKeyData(KEY_DES, 16, 0);
+    i_3K3Des.SetKeyData(KEY_DES, 24, 0);
+
+    Benchmark("AES",    &i_Aes);
+    Benchmark("DES",    &i_Des);
+    Benchmark("2K3DES", &i_2K3Des);
+    Benchmark("3K3DES", &i_3K3Des);
+
+    printf("%d test(s) failed\n", s32_Failed);
+    return s32_Failed ? 1 : 0;
+}
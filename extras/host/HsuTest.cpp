@@ -0,0 +1,202 @@
+/**************************************************************************
+
+    Host test for the HSU transport: PN532::SetSerialBaudRate() talks over a pseudo terminal
+    to a small PN532 stand-in that runs in a second thread.
+    The stand-in answers only commands that arrive with its own baudrate, which it reads
+    from the terminal settings. So a command that is sent with the wrong baudrate gets no response.
+    Build and run on Linux from the root folder of the repository:
+
+    g++ -std=gnu++11 -pthread -DUSE_HSU=true -Iextras/host -I. extras/host/HsuTest.cpp extras/host/Arduino.cpp \
+        extras/host/TermiosSerial.cpp PN532.cpp PN532Transport.cpp Utils.cpp -o HsuTest && ./HsuTest
+
+    returns 0 if all tests pass
+
+**************************************************************************/
+
+#include "PN532.h"
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <termios.h>
+#include <thread>
+#include <atomic>
+
+static int s32_Failed = 0;
+
+static std::atomic<uint32_t> gu32_StandInBaud(115200); // the baudrate of the stand-in
+static std::atomic<bool>     gb_StandInNack(false);    // true -> the stand-in rejects SetSerialBaudRate with a NACK
+static std::atomic<bool>     gb_StandInStop(false);
+
+static void Check(const char* s8_Name, bool b_OK)
+{
+    printf("%s %s\n", b_OK ? "PASS" : "FAIL", s8_Name);
+    if (!b_OK)
+        s32_Failed ++;
+}
+
+// returns the baudrate that the host has set on the pseudo terminal
+static uint32_t GetHostBaud(int s32_Master)
+{
+    termios k_Term;
+    tcgetattr(s32_Master, &k_Term);
+    switch (cfgetospeed(&k_Term))
+    {
+        case B9600:   return 9600;
+        case B19200:  return 19200;
+        case B38400:  return 38400;
+        case B57600:  return 57600;
+        case B115200: return 115200;
+        case B230400: return 230400;
+        case B460800: return 460800;
+        case B921600: return 921600;
+        default:      return 0;
+    }
+}
+
+// Reads one byte from the host. returns -1 if nothing arrives within 100 ms.
+static int StandInRead(int s32_Master)
+{
+    pollfd k_Poll = { s32_Master, POLLIN, 0 };
+    byte u8_Data;
+    if (poll(&k_Poll, 1, 100) <= 0 || read(s32_Master, &u8_Data, 1) != 1)
+        return -1;
+    return u8_Data;
+}
+
+// Sends ACK + a response frame with the TFI D5 and the command + 1
+static void StandInRespond(int s32_Master, byte u8_Command, const byte* u8_Data, byte u8_Length)
+{
+    static const byte ACK[] = { 0x00, 0x00, 0xFF, 0x00, 0xFF, 0x00 };
+    byte u8_Frame[32];
+    int  P = 0;
+    memcpy(u8_Frame, ACK, sizeof(ACK));
+    P += sizeof(ACK);
+
+    u8_Frame[P++] = PN532_PREAMBLE;
+    u8_Frame[P++] = PN532_STARTCODE1;
+    u8_Frame[P++] = PN532_STARTCODE2;
+    u8_Frame[P++] = u8_Length + 2;
+    u8_Frame[P++] = (byte)(0x100 - (u8_Length + 2));
+    u8_Frame[P++] = PN532_PN532TOHOST;
+    u8_Frame[P++] = u8_Command + 1;
+    byte u8_Sum = PN532_PN532TOHOST + u8_Command + 1;
+    for (byte i=0; i<u8_Length; i++)
+    {
+        u8_Frame[P++] = u8_Data[i];
+        u8_Sum += u8_Data[i];
+    }
+    u8_Frame[P++] = (byte)(0x100 - u8_Sum);
+    u8_Frame[P++] = PN532_POSTAMBLE;
+    write(s32_Master, u8_Frame, P);
+}
+
+// Emulates the few commands of the test. A command is ignored if the host uses another baudrate than the stand-in.
+// The ACK that confirms SetSerialBaudRate is not checked because the host switches immediately after sending it.
+static void StandIn(int s32_Master)
+{
+    static const uint32_t u32_Rates[] = { 9600, 19200, 38400, 57600, 115200, 230400, 460800, 921600, 1288000 };
+    uint32_t u32_NewBaud = 0; // != 0 while waiting for the ACK of SetSerialBaudRate
+
+    while (!gb_StandInStop)
+    {
+        // Skip the wake up bytes and the preamble until the start code 00 FF
+        int s32_Prev = -1, s32_Byte = -1;
+        while (!gb_StandInStop && !(s32_Prev == 0x00 && s32_Byte == 0xFF))
+        {
+            s32_Prev = s32_Byte;
+            s32_Byte = StandInRead(s32_Master);
+        }
+        if (gb_StandInStop)
+            break;
+
+        byte u8_Frame[64];
+        int  s32_Len = StandInRead(s32_Master);
+        int  s32_Lcs = StandInRead(s32_Master);
+        if (s32_Len == 0x00 && s32_Lcs == 0xFF) // ACK
+        {
+            if (u32_NewBaud)
+                gu32_StandInBaud = u32_NewBaud;
+            u32_NewBaud = 0;
+            continue;
+        }
+        if (s32_Len <= 0 || s32_Len > (int)sizeof(u8_Frame) || ((s32_Len + s32_Lcs) & 0xFF) != 0)
+            continue;
+
+        for (int i=0; i<s32_Len; i++)
+        {
+            u8_Frame[i] = StandInRead(s32_Master);
+        }
+        StandInRead(s32_Master); // DCS
+        StandInRead(s32_Master); // postamble
+
+        if (GetHostBaud(s32_Master) != gu32_StandInBaud)
+            continue; // garbage for the PN532
+
+        u32_NewBaud = 0;
+        switch (u8_Frame[1])
+        {
+            case PN532_COMMAND_GETFIRMWAREVERSION:
+            {
+                static const byte VERSION[] = { 0x32, 0x01, 0x06, 0x07 };
+                StandInRespond(s32_Master, u8_Frame[1], VERSION, sizeof(VERSION));
+                break;
+            }
+            case PN532_COMMAND_SETSERIALBAUDRATE:
+            {
+                if (gb_StandInNack)
+                {
+                    static const byte NACK[] = { 0x00, 0x00, 0xFF, 0xFF, 0x00, 0x00 };
+                    write(s32_Master, NACK, sizeof(NACK));
+                    break;
+                }
+                // The PN532 answers with the old baudrate and switches after the ACK of the host
+                u32_NewBaud = u32_Rates[u8_Frame[2]];
+                StandInRespond(s32_Master, u8_Frame[1], NULL, 0);
+                break;
+            }
+            default:
+                StandInRespond(s32_Master, u8_Frame[1], NULL, 0);
+                break;
+        }
+    }
+}
+
+int main()
+{
+    int s32_Master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (s32_Master < 0 || grantpt(s32_Master) != 0 || unlockpt(s32_Master) != 0 || !Serial1.Open(ptsname(s32_Master)))
+    {
+        printf("Cannot open a pseudo terminal\n");
+        return 1;
+    }
+    std::thread i_StandIn(StandIn, s32_Master);
+
+    PN532 i_PN532;
+    byte IC, VersionHi, VersionLo, Flags;
+    i_PN532.InitHSU(0);
+
+    // 1.) The PN532 accepts the new baudrate
+    i_PN532.begin();
+    Check("GetFirmwareVersion() with 115200 baud",  i_PN532.GetFirmwareVersion(&IC, &VersionHi, &VersionLo, &Flags));
+    Check("SetSerialBaudRate() succeeds",           i_PN532.SetSerialBaudRate(PN532_HSU_BAUD));
+    Check("Host uses the new baudrate",             GetHostBaud(s32_Master) == PN532_HSU_BAUD);
+    Check("GetFirmwareVersion() with new baudrate", i_PN532.GetFirmwareVersion(&IC, &VersionHi, &VersionLo, &Flags));
+
+    // 2.) The PN532 rejects the command with a NACK -> the host must stay at 115200 baud.
+    // The reset in begin() switches the PN532 back to 115200 baud.
+    gu32_StandInBaud = 115200;
+    gb_StandInNack   = true;
+    i_PN532.begin();
+    Check("SetSerialBaudRate() fails on NACK",      !i_PN532.SetSerialBaudRate(PN532_HSU_BAUD));
+    Check("Host stays at 115200 baud",              GetHostBaud(s32_Master) == 115200);
+    Check("GetFirmwareVersion() after the NACK",    i_PN532.GetFirmwareVersion(&IC, &VersionHi, &VersionLo, &Flags));
+
+    // 3.) An invalid baudrate is not sent to the PN532
+    Check("SetSerialBaudRate(12345) fails",         !i_PN532.SetSerialBaudRate(12345));
+
+    gb_StandInStop = true;
+    i_StandIn.join();
+
+    printf("%d test(s) failed\n", s32_Failed);
+    return s32_Failed ? 1 : 0;
+}
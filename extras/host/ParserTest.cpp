@@ -0,0 +1,84 @@
+/**************************************************************************
+
+    Host test for PN532Parser: feeds valid and malformed frames byte by byte.
+    Build and run on Linux from the root folder of the repository:
+
+    g++ -std=gnu++11 -Iextras/host -I. extras/host/ParserTest.cpp extras/host/Arduino.cpp \
+        PN532.cpp PN532Transport.cpp Utils.cpp -o ParserTest && ./ParserTest
+
+    returns 0 if all tests pass
+
+**************************************************************************/
+
+#include "PN532.h"
+
+static int s32_Failed = 0;
+
+// Feeds the bytes until the parser returns a result and checks the result and the count of bytes consumed.
+// u16_Expect = the expected GetDataLength() for PARSE_Data
+static void Check(const char* s8_Name, const byte* u8_Frame, int s32_Length, eParseResult e_Expect,
+                  int s32_Consumed, uint16_t u16_Size = 16, uint16_t u16_Expect = 0)
+{
+    byte u8_Buffer[16];
+    PN532Parser i_Parser;
+    i_Parser.Begin(u8_Buffer, u16_Size);
+
+    eParseResult e_Result = PARSE_More;
+    int P = 0;
+    while (P < s32_Length && e_Result == PARSE_More)
+    {
+        e_Result = i_Parser.Feed(u8_Frame[P++]);
+    }
+
+    bool b_OK = e_Result == e_Expect && P == s32_Consumed;
+    if (b_OK && e_Result == PARSE_Data)
+        b_OK = i_Parser.GetDataLength() == u16_Expect && u8_Buffer[0] == PN532_PN532TOHOST;
+
+    printf("%s %-28s %s\n", b_OK ? "PASS" : "FAIL", s8_Name, PN532Parser::GetResultText(e_Result));
+    if (!b_OK)
+        s32_Failed ++;
+}
+
+#define CHECK(name, frame, ...)  Check(name, frame, sizeof(frame), __VA_ARGS__)
+
+int main()
+{
+    // InListPassiveTarget response without targets: D5 4B 00
+    static const byte NORMAL[]      = { 0x00, 0x00, 0xFF, 0x03, 0xFD, 0xD5, 0x4B, 0x00, 0xE0, 0x00 };
+    static const byte LEADING[]     = { 0x55, 0x00, 0x12, 0x00, 0x00, 0xFF, 0x03, 0xFD, 0xD5, 0x4B, 0x00, 0xE0, 0x00 };
+    static const byte EXTENDED[]    = { 0x00, 0x00, 0xFF, 0xFF, 0xFF, 0x00, 0x03, 0xFD, 0xD5, 0x4B, 0x00, 0xE0, 0x00 };
+    static const byte ACK[]         = { 0x00, 0x00, 0xFF, 0x00, 0xFF, 0x00 };
+    static const byte NACK[]        = { 0x00, 0x00, 0xFF, 0xFF, 0x00, 0x00 };
+    static const byte ERROR[]       = { 0x00, 0x00, 0xFF, 0x01, 0xFF, 0x7F, 0x81, 0x00 };
+    static const byte ERROR_DCS[]   = { 0x00, 0x00, 0xFF, 0x01, 0xFF, 0x7F, 0x80, 0x00 };
+    static const byte BAD_LCS[]     = { 0x00, 0x00, 0xFF, 0x03, 0xFC, 0xD5, 0x4B, 0x00, 0xE0, 0x00 };
+    static const byte BAD_DCS[]     = { 0x00, 0x00, 0xFF, 0x03, 0xFD, 0xD5, 0x4B, 0x00, 0xE1, 0x00 };
+    static const byte BAD_TFI[]     = { 0x00, 0x00, 0xFF, 0x03, 0xFD, 0xD4, 0x4B, 0x00, 0xE1, 0x00 };
+    static const byte ZERO_LEN[]    = { 0x00, 0x00, 0xFF, 0x00, 0x00, 0x00 };
+    static const byte EXT_BAD_LEN[] = { 0x00, 0x00, 0xFF, 0xFF, 0xFF, 0x00, 0x03, 0xFC, 0xD5, 0x4B, 0x00, 0xE0, 0x00 };
+    static const byte EXT_ZERO[]    = { 0x00, 0x00, 0xFF, 0xFF, 0xFF, 0x00, 0x00, 0x00 };
+    static const byte TRUNC_HEAD[]  = { 0x00, 0x00, 0xFF, 0x03 };
+    static const byte TRUNC_DATA[]  = { 0x00, 0x00, 0xFF, 0x03, 0xFD, 0xD5, 0x4B };
+    static const byte NO_START[]    = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
+
+    CHECK("Normal frame",            NORMAL,      PARSE_Data,        9, 16, 3);
+    CHECK("Leading garbage",         LEADING,     PARSE_Data,       12, 16, 3);
+    CHECK("Extended frame",          EXTENDED,    PARSE_Data,       12, 16, 3);
+    CHECK("ACK",                     ACK,         PARSE_Ack,         5);
+    CHECK("NACK",                    NACK,        PARSE_Nack,        5);
+    CHECK("Error frame",             ERROR,       PARSE_ErrorFrame,  7);
+    CHECK("Error frame bad DCS",     ERROR_DCS,   PARSE_BadChecksum, 7);
+    CHECK("Bad LCS",                 BAD_LCS,     PARSE_BadLength,   5);
+    CHECK("Bad DCS",                 BAD_DCS,     PARSE_BadChecksum, 9);
+    CHECK("Bad TFI",                 BAD_TFI,     PARSE_BadTfi,      6);
+    CHECK("LEN 0",                   ZERO_LEN,    PARSE_BadTfi,      5);
+    CHECK("Extended bad LEN",        EXT_BAD_LEN, PARSE_BadLength,   8);
+    CHECK("Extended LEN 0",          EXT_ZERO,    PARSE_BadTfi,      8);
+    CHECK("Frame too long",          NORMAL,      PARSE_Overflow,    6,  2);
+    CHECK("Truncated header",        TRUNC_HEAD,  PARSE_More,        4);
+    CHECK("Truncated data",          TRUNC_DATA,  PARSE_More,        7);
+    CHECK("No start code",           NO_START,    PARSE_More,        6);
+
+    printf("%d test(s) failed\n", s32_Failed);
+    return s32_Failed ? 1 : 0;
+}
@@ -0,0 +1,85 @@
+/**************************************************************************
+
+    Serial1 for the host tests in HSU mode (see Arduino.h)
+    It uses a serial device (e.g. /dev/ttyUSB0) or a pseudo terminal of Linux in raw mode.
+    On a pseudo terminal the baudrate does not change the transfer, but the other side
+    can read it with tcgetattr() and check that both sides use the same baudrate.
+
+**************************************************************************/
+
+#include "Arduino.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+
+TermiosSerial Serial1;
+
+TermiosSerial::TermiosSerial()
+{
+    ms32_Handle = -1;
+}
+
+// Opens the device in raw mode with 115200 baud
+bool TermiosSerial::Open(const char* s8_Device)
+{
+    ms32_Handle = open(s8_Device, O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (ms32_Handle < 0)
+        return false;
+
+    termios k_Term;
+    tcgetattr(ms32_Handle, &k_Term);
+    cfmakeraw(&k_Term);
+    tcsetattr(ms32_Handle, TCSANOW, &k_Term);
+    begin(115200);
+    return true;
+}
+
+void TermiosSerial::begin(uint32_t u32_Baud)
+{
+    static const struct { uint32_t u32_Baud; speed_t k_Speed; } k_Speeds[] =
+    {
+        { 9600, B9600 }, { 19200, B19200 }, { 38400, B38400 }, { 57600, B57600 }, { 115200, B115200 },
+        { 230400, B230400 }, { 460800, B460800 }, { 921600, B921600 },
+    };
+
+    for (size_t i=0; i<sizeof(k_Speeds) / sizeof(k_Speeds[0]); i++)
+    {
+        if (k_Speeds[i].u32_Baud == u32_Baud)
+        {
+            termios k_Term;
+            tcgetattr(ms32_Handle, &k_Term);
+            cfsetspeed(&k_Term, k_Speeds[i].k_Speed);
+            tcsetattr(ms32_Handle, TCSADRAIN, &k_Term);
+            return;
+        }
+    }
+    printf("TermiosSerial: %u baud is not supported\n", u32_Baud);
+}
+
+int TermiosSerial::available()
+{
+    int s32_Count = 0;
+    if (ioctl(ms32_Handle, FIONREAD, &s32_Count) < 0)
+        return 0;
+    return s32_Count;
+}
+
+int TermiosSerial::read()
+{
+    uint8_t u8_Data;
+    if (::read(ms32_Handle, &u8_Data, 1) != 1)
+        return -1;
+    return u8_Data;
+}
+
+size_t TermiosSerial::write(const uint8_t* u8_Data, size_t u32_Length)
+{
+    ssize_t s32_Written = ::write(ms32_Handle, u8_Data, u32_Length);
+    return s32_Written < 0 ? 0 : s32_Written;
+}
+
+void TermiosSerial::flush()
+{
+    tcdrain(ms32_Handle);
+}